@@ -1,8 +1,10 @@
+#include <cstdio>
+
 #include "filter_regs.h"
 
 #define DEBUG_REGS
 
-void FilterRegs::realize(reSID::SID &sid)
+void FilterRegs::realize(SidRenderer &renderer)
 {
     int offset = 21;
     int mask = 1;
@@ -14,7 +16,7 @@ void FilterRegs::realize(reSID::SID &sid)
 #endif
     for(int i=0;i<NUM_REGS;i++) {
         if((dirty & mask) == mask) {
-            sid.write(offset, regs[i]);
+            renderer.write(offset, regs[i]);
 #ifdef DEBUG_SID
             printf(" @%02x=%02x", offset, regs[i]);
 #endif
@@ -37,6 +39,21 @@ void FilterRegs::reset()
     dirty = 0xff;
 }
 
+void FilterRegs::setRegs(const uint8_t *values)
+{
+    for(int i=0;i<NUM_REGS;i++) {
+        uint8_t value = values[i];
+        // unused bits like the setters
+        if(i == CUTOFF_LO) {
+            value &= 7;
+        }
+        if(regs[i] != value) {
+            regs[i] = value;
+            dirty |= 1<<i;
+        }
+    }
+}
+
 void FilterRegs::setCutOff(uint16_t freq)
 {
     freq &= CUTOFF_MAX;
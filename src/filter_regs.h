@@ -1,6 +1,6 @@
 #pragma once
-#include <rack.hpp>
-#include "sid.h"
+#include <cstdint>
+#include "sid_renderer.h"
 
 struct FilterRegs {
     enum Regs {
@@ -25,8 +25,10 @@ struct FilterRegs {
     static constexpr uint8_t  MODE_MASK = 0x70;
     static constexpr uint8_t  MODE_VOICE3OFF = 0x80;
 
-    void realize(reSID::SID &sid);
+    void realize(SidRenderer &renderer);
     void reset();
+    // all NUM_REGS registers at once, e.g. a frame of a register dump
+    void setRegs(const uint8_t *values);
 
     void setCutOff(uint16_t freq);
     void setResonance(uint8_t res);
@@ -0,0 +1,45 @@
+#include <cmath>
+
+#include "pitch_table.h"
+
+constexpr float PitchTable::FREQ_C4;
+
+PitchTable::PitchTable()
+{
+    for(int i=0;i<=STEPS;i++) {
+        steps[i] = (float)std::exp2((double)i / STEPS);
+    }
+    setClock(985248.0f);
+}
+
+void PitchTable::setClock(float cpuClockHz)
+{
+    // FREQ = freq * 2^24 / clock
+    double c4 = FREQ_C4 * 16777216.0 / cpuClockHz;
+    for(int i=0;i<MAX_OCTAVE - MIN_OCTAVE;i++) {
+        octaves[i] = (float)std::ldexp(c4, i + MIN_OCTAVE);
+    }
+}
+
+uint16_t PitchTable::getFreqReg(float semitones) const
+{
+    float pos = semitones * (STEPS / 12.0f);
+    // also rejects NaN
+    if(!(pos >= MIN_OCTAVE * STEPS)) {
+        return 0;
+    }
+    if(pos >= MAX_OCTAVE * STEPS) {
+        return 65535;
+    }
+    // positive from here on: truncating is floor
+    pos -= MIN_OCTAVE * STEPS;
+    int i = (int)pos;
+    float frac = pos - i;
+    int step = i & (STEPS - 1);
+    float val = steps[step] + (steps[step + 1] - steps[step]) * frac;
+    val = val * octaves[i >> STEPS_BITS] + 0.5f;
+    if(val >= 65535.0f) {
+        return 65535;
+    }
+    return (uint16_t)val;
+}
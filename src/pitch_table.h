@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+
+// Maps a pitch in semitones relative to C4 (the module's 1V/Oct input times
+// 12 plus the knob) directly to the 16 bit FREQ register of a SID clocked
+// with the given CPU clock. Replaces std::pow() and the divide of the
+// register update with a linearly interpolated table of one octave and a
+// per octave scale, so it is cheap enough to run on every sample.
+//
+// The register is at most 0.1 steps off the exact value before rounding, so
+// it only differs by one from the pow() mapping where that one is that close
+// to a rounding boundary.
+struct PitchTable {
+    static constexpr float FREQ_C4 = 261.6256f;
+    // entries per octave, a power of two
+    static constexpr int STEPS_BITS = 8;
+    static constexpr int STEPS = 1 << STEPS_BITS;
+    // octaves below C4 that round to FREQ register 0 with the lowest clock,
+    // octaves above C4 that exceed the register with the highest clock
+    static constexpr int MIN_OCTAVE = -16;
+    static constexpr int MAX_OCTAVE = 5;
+
+    PitchTable();
+
+    // builder thread: scale for the real CPU clock of an engine
+    void setClock(float cpuClockHz);
+
+    // audio thread: clamped to 0..65535
+    uint16_t getFreqReg(float semitones) const;
+
+protected:
+    // 2^(i/STEPS) for one octave and the first entry of the next one
+    float steps[STEPS + 1];
+    // register value of octave C4 + n
+    float octaves[MAX_OCTAVE - MIN_OCTAVE];
+};
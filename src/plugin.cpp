@@ -1,8 +1,20 @@
 #include "plugin.hpp"
+#include "sid.h"
 
 Plugin* pluginInstance;
 
 void init(Plugin* p) {
 	pluginInstance = p;
 	p->addModel(modelSidofon);
+
+	// the filter tables of reSID are built on the first use of a chip model
+	// and cached in the user dir for the next start of Rack
+	std::string tableCache = asset::user(p->slug);
+	try {
+		system::createDirectories(tableCache);
+		reSID::Filter::set_table_cache(tableCache.c_str());
+	}
+	catch (Exception& e) {
+		WARN("Sidofon: no filter table cache: %s", e.what());
+	}
 }
@@ -0,0 +1,174 @@
+//  ---------------------------------------------------------------------------
+//  This file is part of reSID, a MOS6581 SID emulator engine.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//  ---------------------------------------------------------------------------
+
+#define RESID_CONVOLVE_CC
+
+#include "convolve.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RESID_CONVOLVE_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define RESID_CONVOLVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace reSID
+{
+
+// ----------------------------------------------------------------------------
+// Portable kernel.
+// ----------------------------------------------------------------------------
+int convolve_scalar(const short* a, const short* b, int n)
+{
+  int out = 0;
+  for (int i = 0; i < n; i++) {
+    out += a[i]*b[i];
+  }
+  return out;
+}
+
+
+#if RESID_CONVOLVE_X86
+
+// ----------------------------------------------------------------------------
+// SSE2 kernel: 8 taps per step.
+// pmaddwd sums pairs of 16x16 bit products; the only case not fitting 32 bits
+// (-32768*-32768*2) wraps around just as the scalar sum does.
+// ----------------------------------------------------------------------------
+__attribute__((target("sse2")))
+static int convolve_sse2(const short* a, const short* b, int n)
+{
+  __m128i acc = _mm_setzero_si128();
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+  }
+
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4e));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xb1));
+  int out = _mm_cvtsi128_si32(acc);
+
+  for (; i < n; i++) {
+    out += a[i]*b[i];
+  }
+  return out;
+}
+
+
+// ----------------------------------------------------------------------------
+// AVX2 kernel: 16 taps per step.
+// ----------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static int convolve_avx2(const short* a, const short* b, int n)
+{
+  __m256i acc = _mm256_setzero_si256();
+  int i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+  }
+
+  __m128i acc4 = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                               _mm256_extracti128_si256(acc, 1));
+  if (i + 8 <= n) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+    acc4 = _mm_add_epi32(acc4, _mm_madd_epi16(va, vb));
+    i += 8;
+  }
+
+  acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, 0x4e));
+  acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, 0xb1));
+  int out = _mm_cvtsi128_si32(acc4);
+
+  for (; i < n; i++) {
+    out += a[i]*b[i];
+  }
+  return out;
+}
+
+#endif // RESID_CONVOLVE_X86
+
+
+#if RESID_CONVOLVE_NEON
+
+// ----------------------------------------------------------------------------
+// NEON kernel: 8 taps per step.
+// ----------------------------------------------------------------------------
+static int convolve_neon(const short* a, const short* b, int n)
+{
+  int32x4_t acc = vdupq_n_s32(0);
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t va = vld1q_s16(a + i);
+    int16x8_t vb = vld1q_s16(b + i);
+    acc = vmlal_s16(acc, vget_low_s16(va), vget_low_s16(vb));
+    acc = vmlal_s16(acc, vget_high_s16(va), vget_high_s16(vb));
+  }
+
+  int32x2_t acc2 = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+  int out = vget_lane_s32(vpadd_s32(acc2, acc2), 0);
+
+  for (; i < n; i++) {
+    out += a[i]*b[i];
+  }
+  return out;
+}
+
+#endif // RESID_CONVOLVE_NEON
+
+
+// ----------------------------------------------------------------------------
+// Runtime dispatch.
+// ----------------------------------------------------------------------------
+static const char* kernel_name = "scalar";
+
+static convolve_func select_convolve()
+{
+#if RESID_CONVOLVE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernel_name = "avx2";
+    return convolve_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    kernel_name = "sse2";
+    return convolve_sse2;
+  }
+#elif RESID_CONVOLVE_NEON
+  kernel_name = "neon";
+  return convolve_neon;
+#endif
+  return convolve_scalar;
+}
+
+convolve_func convolve = select_convolve();
+
+const char* convolve_kernel_name()
+{
+  return kernel_name;
+}
+
+} // namespace reSID
@@ -0,0 +1,44 @@
+//  ---------------------------------------------------------------------------
+//  This file is part of reSID, a MOS6581 SID emulator engine.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//  ---------------------------------------------------------------------------
+
+#ifndef RESID_CONVOLVE_H
+#define RESID_CONVOLVE_H
+
+#include "resid-config.h"
+
+namespace reSID
+{
+
+// ----------------------------------------------------------------------------
+// FIR convolution kernel used by the resampling code.
+// Computes sum(a[i]*b[i]) for i in [0, n) with 32 bit wrap-around
+// accumulation. All variants yield bit identical results; the fastest one
+// supported by the CPU is selected at startup.
+// ----------------------------------------------------------------------------
+typedef int (*convolve_func)(const short* a, const short* b, int n);
+
+extern convolve_func convolve;
+
+// Name of the selected kernel ("scalar", "sse2", "avx2" or "neon").
+const char* convolve_kernel_name();
+
+int convolve_scalar(const short* a, const short* b, int n);
+
+} // namespace reSID
+
+#endif // not RESID_CONVOLVE_H
@@ -45,6 +45,7 @@ public:
 
   void clock();
   void clock(cycle_count delta_t);
+  void clock_batch(short* out, int n);
   void reset();
 
   void writeCONTROL_REG(reg8);
@@ -193,6 +194,35 @@ void EnvelopeGenerator::clock()
 }
 
 
+// ----------------------------------------------------------------------------
+// SID clocking - n single cycles, storing the output of each cycle.
+// Between envelope steps only the rate counter counts, so the cycles are
+// skipped at once unless the rate counter reaches the rate period or a
+// pipeline is pending.
+// ----------------------------------------------------------------------------
+RESID_INLINE
+void EnvelopeGenerator::clock_batch(short* out, int n)
+{
+  // The rate counter must not match the rate period within n cycles. Above
+  // the period (ADSR delay bug) it must not wrap around.
+  int limit = rate_counter <= rate_period ? int(rate_period) : 0x7fff;
+  if (likely(!(state_pipeline | envelope_pipeline | exponential_pipeline)) &&
+      likely(!reset_rate_counter) && likely(int(rate_counter) + n <= limit)) {
+    env3 = envelope_counter;
+    rate_counter += n;
+    short value = output();
+    for (int c = 0; c < n; c++) {
+      out[c] = value;
+    }
+    return;
+  }
+
+  for (int c = 0; c < n; c++) {
+    clock();
+    out[c] = output();
+  }
+}
+
 // ----------------------------------------------------------------------------
 // SID clocking - delta_t cycles.
 // ----------------------------------------------------------------------------
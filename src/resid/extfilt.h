@@ -79,6 +79,7 @@ protected:
   int w0hp_1_s17;
 
 friend class SID;
+friend class SIDBank;
 };
 
 
@@ -28,6 +28,16 @@
 #include "dac.h"
 #include "spline.h"
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
 
 namespace reSID
 {
@@ -191,245 +201,564 @@ static double log1p(double x)
 
 Filter::model_filter_t Filter::model_filter[2];
 
+static std::once_flag model_filter_once[2];
+
+// Table cache directory, see set_table_cache().
+static std::string table_cache_dir;
+
+typedef struct {
+    char magic[8];
+    unsigned int key;
+    int model;
+    int size;
+    unsigned int checksum;
+} table_cache_header_t;
+
 
 // ----------------------------------------------------------------------------
 // Constructor.
+// The lookup tables are only built for the chip models actually used, see
+// set_chip_model(). Until a model is selected, reset or written to, the
+// filter waits for the tables of the default MOS6581.
 // ----------------------------------------------------------------------------
 Filter::Filter()
 {
-    static bool class_init;
-
-    if (!class_init) {
-        // Temporary table for op-amp transfer function.
-        unsigned int* voltages = new unsigned int[1 << 16];
-        opamp_t* opamp = new opamp_t[1 << 16];
-
-        for (int m = 0; m < 2; m++) {
-            model_filter_init_t& fi = model_filter_init[m];
-            model_filter_t& mf = model_filter[m];
-
-            // Convert op-amp voltage transfer to 16 bit values.
-            double vmin = fi.opamp_voltage[0][0];
-            double opamp_max = fi.opamp_voltage[0][1];
-            double kVddt = fi.k*(fi.Vdd - fi.Vth);
-            double vmax = kVddt < opamp_max ? opamp_max : kVddt;
-            double denorm = vmax - vmin;
-            double norm = 1.0/denorm;
-
-            // Scaling and translation constants.
-            double N16 = norm*((1u << 16) - 1);
-            double N30 = norm*((1u << 30) - 1);
-            double N31 = norm*((1u << 31) - 1);
-            mf.vo_N16 = (int)(N16);  // FIXME: Remove?
-
-            // The "zero" output level of the voices.
-            // The digital range of one voice is 20 bits; create a scaling term
-            // for multiplication which fits in 11 bits.
-            double N14 = norm*(1u << 14);
-            mf.voice_scale_s14 = (int)(N14*fi.voice_voltage_range);
-            mf.voice_DC = (int)(N16*(fi.voice_DC_voltage - vmin));
-
-            // Vdd - Vth, normalized so that translated values can be subtracted:
-            // k*Vddt - x = (k*Vddt - t) - (x - t)
-            mf.kVddt = (int)(N16*(kVddt - vmin) + 0.5);
-
-            // Normalized snake current factor, 1 cycle at 1MHz.
-            // Fit in 5 bits.
-            mf.n_snake = (int)(denorm*(1 << 13)*(fi.uCox/(2*fi.k)*fi.WL_snake*1.0e-6/fi.C) + 0.5);
-
-            // Create lookup table mapping op-amp voltage across output and input
-            // to input voltage: vo - vx -> vx
-            // FIXME: No variable length arrays in ISO C++, hardcoding to max 50
-            // points.
-            // double_point scaled_voltage[fi.opamp_voltage_size];
-            double_point scaled_voltage[50];
-
-            for (int i = 0; i < fi.opamp_voltage_size; i++) {
-                // The target output range is 16 bits, in order to fit in an unsigned
-                // short.
-                //
-                // The y axis is temporarily scaled to 31 bits for maximum accuracy in
-                // the calculated derivative.
-                //
-                // Values are normalized using
-                //
-                //   x_n = m*2^N*(x - xmin)
-                //
-                // and are translated back later (for fixed point math) using
-                //
-                //   m*2^N*x = x_n - m*2^N*xmin
-                //
-                scaled_voltage[fi.opamp_voltage_size - 1 - i][0] = int(N16*(fi.opamp_voltage[i][1] - fi.opamp_voltage[i][0] + denorm)/2 + 0.5);
-                scaled_voltage[fi.opamp_voltage_size - 1 - i][1] = N31*(fi.opamp_voltage[i][0] - vmin);
-            }
-
-            // Clamp x to 16 bits (rounding may cause overflow).
-            if (scaled_voltage[fi.opamp_voltage_size - 1][0] >= (1 << 16)) {
-                // The last point is repeated.
-                scaled_voltage[fi.opamp_voltage_size - 1][0] =
-                scaled_voltage[fi.opamp_voltage_size - 2][0] = (1 << 16) - 1;
-            }
-
-            interpolate(scaled_voltage, scaled_voltage + fi.opamp_voltage_size - 1,
-                PointPlotter<unsigned int>(voltages), 1.0);
-
-            // Store both fn and dfn in the same table.
-            mf.ak = (int)scaled_voltage[0][0];
-            mf.bk = (int)scaled_voltage[fi.opamp_voltage_size - 1][0];
-            int j;
-            for (j = 0; j < mf.ak; j++) {
-                opamp[j].vx = 0;
-                opamp[j].dvx = 0;
-            }
-            unsigned int f = voltages[j];
-            for (; j <= mf.bk; j++) {
-                unsigned int fp = f;
-                f = voltages[j];  // Scaled by m*2^31
-                // m*2^31*dy/1 = (m*2^31*dy)/(m*2^16*dx) = 2^15*dy/dx
-                int df = f - fp;  // Scaled by 2^15
-
-                // 16 bits unsigned: m*2^16*(fn - xmin)
-                opamp[j].vx = f > (0xffff << 15) ? 0xffff : f >> 15;
-                // 16 bits (15 bits + sign bit): 2^11*dfn
-                opamp[j].dvx = df >> (15 - 11);
-            }
-            for (; j < (1 << 16); j++) {
-                opamp[j].vx = 0;
-                opamp[j].dvx = 0;
-            }
-
-            // Create lookup tables for gains / summers.
-
-            // 4 bit "resistor" ladders in the bandpass resonance gain and the audio
-            // output gain necessitate 16 gain tables.
-            // From die photographs of the bandpass and volume "resistor" ladders
-            // it follows that gain ~ vol/8 and 1/Q ~ ~res/8 (assuming ideal
-            // op-amps and ideal "resistors").
-            for (int n8 = 0; n8 < 16; n8++) {
-                int n = n8 << 4;  // Scaled by 2^7
-                int x = mf.ak;
-                for (int vi = 0; vi < (1 << 16); vi++) {
-                    mf.gain[n8][vi] = solve_gain(opamp, n, vi, x, mf);
-                }
-            }
-
-            // The filter summer operates at n ~ 1, and has 5 fundamentally different
-            // input configurations (2 - 6 input "resistors").
-            //
-            // Note that all "on" transistors are modeled as one. This is not
-            // entirely accurate, since the input for each transistor is different,
-            // and transistors are not linear components. However modeling all
-            // transistors separately would be extremely costly.
-            int offset = 0;
-            int size;
-            for (int k = 0; k < 5; k++) {
-                int idiv = 2 + k;        // 2 - 6 input "resistors".
-                int n_idiv = idiv << 7;  // n*idiv, scaled by 2^7
-                size = idiv << 16;
-                int x = mf.ak;
-                for (int vi = 0; vi < size; vi++) {
-                    mf.summer[offset + vi] = solve_gain(opamp, n_idiv, vi/idiv, x, mf);
-                }
-                offset += size;
-            }
-
-            // The audio mixer operates at n ~ 8/6, and has 8 fundamentally different
-            // input configurations (0 - 7 input "resistors").
-            //
-            // All "on", transistors are modeled as one - see comments above for
-            // the filter summer.
-            offset = 0;
-            size = 1;  // Only one lookup element for 0 input "resistors".
-            for (int l = 0; l < 8; l++) {
-                int idiv = l;                 // 0 - 7 input "resistors".
-                int n_idiv = (idiv << 7)*8/6; // n*idiv, scaled by 2^7
-                if (idiv == 0) {
-                    // Avoid division by zero; the result will be correct since
-                    // n_idiv = 0.
-                    idiv = 1;
-                }
-                int x = mf.ak;
-                for (int vi = 0; vi < size; vi++) {
-                    mf.mixer[offset + vi] = solve_gain(opamp, n_idiv, vi/idiv, x, mf);
-                }
-                offset += size;
-                size = (l + 1) << 16;
-            }
-
-            // Create lookup table mapping capacitor voltage to op-amp input voltage:
-            // vc -> vx
-            for (int m = 0; m < (1 << 16); m++) {
-                mf.opamp_rev[m] = opamp[m].vx;
-            }
-
-            mf.vc_max = (int)(N30*(fi.opamp_voltage[0][1] - fi.opamp_voltage[0][0]));
-            mf.vc_min = (int)(N30*(fi.opamp_voltage[fi.opamp_voltage_size - 1][1] - fi.opamp_voltage[fi.opamp_voltage_size - 1][0]));
-
-            // DAC table.
-            int bits = 11;
-            build_dac_table(mf.f0_dac, bits, fi.dac_2R_div_R, fi.dac_term);
-            for (int n = 0; n < (1 << bits); n++) {
-                mf.f0_dac[n] = (unsigned short)(N16*(fi.dac_zero + mf.f0_dac[n]*fi.dac_scale/(1 << bits) - vmin) + 0.5);
-            }
+    model_pending = true;
+    sid_model = MOS6581;
+    Vw_bias = 0;
+    ext_in = 0;
+    ve = 0;
+
+    enable_filter(true);
+    set_voice_mask(0x07);
+
+    fc = 0;
+    res = 0;
+    filt = 0;
+    mode = 0;
+    vol = 0;
+
+    Vhp = 0;
+    Vbp = Vbp_x = Vbp_vc = 0;
+    Vlp = Vlp_x = Vlp_vc = 0;
+    v1 = v2 = v3 = 0;
+
+    Vddt_Vw_2 = 0;
+    w0 = 0;
+    set_Q();
+    set_sum_mix();
+}
+
+
+// ----------------------------------------------------------------------------
+// Build the lookup tables of a chip model on first use. Several threads may
+// create filters concurrently; the tables of a model are built exactly once
+// and are read-only afterwards.
+// ----------------------------------------------------------------------------
+void Filter::init_model_filter(chip_model model)
+{
+    std::call_once(model_filter_once[model], load_model_filter, model);
+}
+
+void Filter::load_model_filter(chip_model model)
+{
+    if (read_table_cache(model)) {
+        return;
+    }
+    build_model_filter(model);
+    write_table_cache(model);
+}
+
+void Filter::build_model_filter(chip_model model)
+{
+    // Temporary table for op-amp transfer function.
+    unsigned int* voltages = new unsigned int[1 << 16];
+    opamp_t* opamp = new opamp_t[1 << 16];
+
+    model_filter_init_t& fi = model_filter_init[model];
+    model_filter_t& mf = model_filter[model];
+
+    // Convert op-amp voltage transfer to 16 bit values.
+    double vmin = fi.opamp_voltage[0][0];
+    double opamp_max = fi.opamp_voltage[0][1];
+    double kVddt = fi.k*(fi.Vdd - fi.Vth);
+    double vmax = kVddt < opamp_max ? opamp_max : kVddt;
+    double denorm = vmax - vmin;
+    double norm = 1.0/denorm;
+
+    // Scaling and translation constants.
+    double N16 = norm*((1u << 16) - 1);
+    double N30 = norm*((1u << 30) - 1);
+    double N31 = norm*((1u << 31) - 1);
+    mf.vo_N16 = (int)(N16);  // FIXME: Remove?
+
+    // The "zero" output level of the voices.
+    // The digital range of one voice is 20 bits; create a scaling term
+    // for multiplication which fits in 11 bits.
+    double N14 = norm*(1u << 14);
+    mf.voice_scale_s14 = (int)(N14*fi.voice_voltage_range);
+    mf.voice_DC = (int)(N16*(fi.voice_DC_voltage - vmin));
+
+    // Vdd - Vth, normalized so that translated values can be subtracted:
+    // k*Vddt - x = (k*Vddt - t) - (x - t)
+    mf.kVddt = (int)(N16*(kVddt - vmin) + 0.5);
+
+    // Normalized snake current factor, 1 cycle at 1MHz.
+    // Fit in 5 bits.
+    mf.n_snake = (int)(denorm*(1 << 13)*(fi.uCox/(2*fi.k)*fi.WL_snake*1.0e-6/fi.C) + 0.5);
+
+    // Create lookup table mapping op-amp voltage across output and input
+    // to input voltage: vo - vx -> vx
+    // FIXME: No variable length arrays in ISO C++, hardcoding to max 50
+    // points.
+    // double_point scaled_voltage[fi.opamp_voltage_size];
+    double_point scaled_voltage[50];
+
+    for (int i = 0; i < fi.opamp_voltage_size; i++) {
+        // The target output range is 16 bits, in order to fit in an unsigned
+        // short.
+        //
+        // The y axis is temporarily scaled to 31 bits for maximum accuracy in
+        // the calculated derivative.
+        //
+        // Values are normalized using
+        //
+        //   x_n = m*2^N*(x - xmin)
+        //
+        // and are translated back later (for fixed point math) using
+        //
+        //   m*2^N*x = x_n - m*2^N*xmin
+        //
+        scaled_voltage[fi.opamp_voltage_size - 1 - i][0] = int(N16*(fi.opamp_voltage[i][1] - fi.opamp_voltage[i][0] + denorm)/2 + 0.5);
+        scaled_voltage[fi.opamp_voltage_size - 1 - i][1] = N31*(fi.opamp_voltage[i][0] - vmin);
+    }
+
+    // Clamp x to 16 bits (rounding may cause overflow).
+    if (scaled_voltage[fi.opamp_voltage_size - 1][0] >= (1 << 16)) {
+        // The last point is repeated.
+        scaled_voltage[fi.opamp_voltage_size - 1][0] =
+        scaled_voltage[fi.opamp_voltage_size - 2][0] = (1 << 16) - 1;
+    }
+
+    interpolate(scaled_voltage, scaled_voltage + fi.opamp_voltage_size - 1,
+        PointPlotter<unsigned int>(voltages), 1.0);
+
+    // Store both fn and dfn in the same table.
+    mf.ak = (int)scaled_voltage[0][0];
+    mf.bk = (int)scaled_voltage[fi.opamp_voltage_size - 1][0];
+    int j;
+    for (j = 0; j < mf.ak; j++) {
+        opamp[j].vx = 0;
+        opamp[j].dvx = 0;
+    }
+    unsigned int f = voltages[j];
+    for (; j <= mf.bk; j++) {
+        unsigned int fp = f;
+        f = voltages[j];  // Scaled by m*2^31
+        // m*2^31*dy/1 = (m*2^31*dy)/(m*2^16*dx) = 2^15*dy/dx
+        int df = f - fp;  // Scaled by 2^15
+
+        // 16 bits unsigned: m*2^16*(fn - xmin)
+        opamp[j].vx = f > (0xffff << 15) ? 0xffff : f >> 15;
+        // 16 bits (15 bits + sign bit): 2^11*dfn
+        opamp[j].dvx = df >> (15 - 11);
+    }
+    for (; j < (1 << 16); j++) {
+        opamp[j].vx = 0;
+        opamp[j].dvx = 0;
+    }
+
+#if RESID_COMPACT_FILTER
+    // The full tables are only needed to build the compact tables.
+    unsigned short (*gain)[1 << 16] = new unsigned short[16][1 << 16];
+    unsigned short* summer = new unsigned short[summer_offset<5>::value];
+    unsigned short* mixer = new unsigned short[mixer_offset<8>::value];
+#else
+    unsigned short (*gain)[1 << 16] = mf.gain;
+    unsigned short* summer = mf.summer;
+    unsigned short* mixer = mf.mixer;
+#endif
+
+    // Create lookup tables for gains / summers.
+
+    // 4 bit "resistor" ladders in the bandpass resonance gain and the audio
+    // output gain necessitate 16 gain tables.
+    // From die photographs of the bandpass and volume "resistor" ladders
+    // it follows that gain ~ vol/8 and 1/Q ~ ~res/8 (assuming ideal
+    // op-amps and ideal "resistors").
+    for (int n8 = 0; n8 < 16; n8++) {
+        int n = n8 << 4;  // Scaled by 2^7
+        int x = mf.ak;
+        for (int vi = 0; vi < (1 << 16); vi++) {
+            gain[n8][vi] = solve_gain(opamp, n, vi, x, mf);
         }
+    }
 
-        // Free temporary tables.
-        delete[] voltages;
-        delete[] opamp;
-
-        // VCR - 6581 only.
-        model_filter_init_t& fi = model_filter_init[0];
-
-        double N16 = model_filter[0].vo_N16;
-        double vmin = N16*fi.opamp_voltage[0][0];
-        double k = fi.k;
-        double kVddt = N16*(k*(fi.Vdd - fi.Vth));
-
-        for (int i = 0; i < (1 << 16); i++) {
-            // The table index is right-shifted 16 times in order to fit in
-            // 16 bits; the argument to sqrt is thus multiplied by (1 << 16).
-            //
-            // The returned value must be corrected for translation. Vg always
-            // takes part in a subtraction as follows:
-            //
-            //   k*Vg - Vx = (k*Vg - t) - (Vx - t)
-            //
-            // I.e. k*Vg - t must be returned.
-            double Vg = kVddt - sqrt((double)i*(1 << 16));
-            vcr_kVg[i] = (unsigned short)(k*Vg - vmin + 0.5);
+    // The filter summer operates at n ~ 1, and has 5 fundamentally different
+    // input configurations (2 - 6 input "resistors").
+    //
+    // Note that all "on" transistors are modeled as one. This is not
+    // entirely accurate, since the input for each transistor is different,
+    // and transistors are not linear components. However modeling all
+    // transistors separately would be extremely costly.
+    int offset = 0;
+    int size;
+    for (int k = 0; k < 5; k++) {
+        int idiv = 2 + k;        // 2 - 6 input "resistors".
+        int n_idiv = idiv << 7;  // n*idiv, scaled by 2^7
+        size = idiv << 16;
+        int x = mf.ak;
+        for (int vi = 0; vi < size; vi++) {
+            summer[offset + vi] = solve_gain(opamp, n_idiv, vi/idiv, x, mf);
         }
+        offset += size;
+    }
 
-        /*
-        EKV model:
-
-        Ids = Is*(if - ir)
-        Is = 2*u*Cox*Ut^2/k*W/L
-        if = ln^2(1 + e^((k*(Vg - Vt) - Vs)/(2*Ut))
-        ir = ln^2(1 + e^((k*(Vg - Vt) - Vd)/(2*Ut))
-        */
-        double kVt = fi.k*fi.Vth;
-        double Ut = fi.Ut;
-        double Is = 2*fi.uCox*Ut*Ut/fi.k*fi.WL_vcr;
-        // Normalized current factor for 1 cycle at 1MHz.
-        double N15 = N16/2;
-        double n_Is = N15*1.0e-6/fi.C*Is;
-
-        // kVg_Vx = k*Vg - Vx
-        // I.e. if k != 1.0, Vg must be scaled accordingly.
-        for (int kVg_Vx = 0; kVg_Vx < (1 << 16); kVg_Vx++) {
-            double log_term = log1p(exp((kVg_Vx/N16 - kVt)/(2*Ut)));
-            // Scaled by m*2^15
-            vcr_n_Ids_term[kVg_Vx] = (unsigned short)(n_Is*log_term*log_term);
+    // The audio mixer operates at n ~ 8/6, and has 8 fundamentally different
+    // input configurations (0 - 7 input "resistors").
+    //
+    // All "on", transistors are modeled as one - see comments above for
+    // the filter summer.
+    offset = 0;
+    size = 1;  // Only one lookup element for 0 input "resistors".
+    for (int l = 0; l < 8; l++) {
+        int idiv = l;                 // 0 - 7 input "resistors".
+        int n_idiv = (idiv << 7)*8/6; // n*idiv, scaled by 2^7
+        if (idiv == 0) {
+            // Avoid division by zero; the result will be correct since
+            // n_idiv = 0.
+            idiv = 1;
+        }
+        int x = mf.ak;
+        for (int vi = 0; vi < size; vi++) {
+            mixer[offset + vi] = solve_gain(opamp, n_idiv, vi/idiv, x, mf);
         }
+        offset += size;
+        size = (l + 1) << 16;
+    }
 
-        class_init = true;
+#if RESID_COMPACT_FILTER
+    int error = 0;
+    for (int n8 = 0; n8 < 16; n8++) {
+        error = std::max(error, build_compact_table(mf.gain[n8], gain[n8], 1 << 16));
+    }
+    offset = 0;
+    for (int k = 0; k < 5; k++) {
+        size = (2 + k) << 16;
+        error = std::max(error, build_compact_table(mf.summer + (offset >> compact_shift), summer + offset, size));
+        offset += size;
+    }
+    // The single entry for 0 input "resistors" is the last one of the
+    // padding block.
+    mf.mixer[0].v = mixer[0];
+    mf.mixer[0].dv = 0;
+    offset = 1;
+    for (int l = 1; l < 8; l++) {
+        size = l << 16;
+        error = std::max(error, build_compact_table(mf.mixer + ((offset + mixer_pad) >> compact_shift), mixer + offset, size));
+        offset += size;
     }
+    mf.compact_error = error;
 
-    enable_filter(true);
-    set_chip_model(MOS6581);
-    set_voice_mask(0x07);
-    input(0);
-    reset();
+    delete[] gain;
+    delete[] summer;
+    delete[] mixer;
+#endif
+
+    // Create lookup table mapping capacitor voltage to op-amp input voltage:
+    // vc -> vx
+    for (int m = 0; m < (1 << 16); m++) {
+        mf.opamp_rev[m] = opamp[m].vx;
+    }
+
+    mf.vc_max = (int)(N30*(fi.opamp_voltage[0][1] - fi.opamp_voltage[0][0]));
+    mf.vc_min = (int)(N30*(fi.opamp_voltage[fi.opamp_voltage_size - 1][1] - fi.opamp_voltage[fi.opamp_voltage_size - 1][0]));
+
+    // DAC table.
+    int bits = 11;
+    build_dac_table(mf.f0_dac, bits, fi.dac_2R_div_R, fi.dac_term);
+    for (int n = 0; n < (1 << bits); n++) {
+        mf.f0_dac[n] = (unsigned short)(N16*(fi.dac_zero + mf.f0_dac[n]*fi.dac_scale/(1 << bits) - vmin) + 0.5);
+    }
+
+    // Free temporary tables.
+    delete[] voltages;
+    delete[] opamp;
+
+    // VCR - 6581 only.
+    if (model == MOS6581) {
+        build_vcr_tables();
+    }
+}
+
+#if RESID_COMPACT_FILTER
+// ----------------------------------------------------------------------------
+// Build a compact table from size entries of a full table, size is a
+// multiple of the block size. Returns the largest interpolation error.
+// ----------------------------------------------------------------------------
+int Filter::build_compact_table(compact_t* table, const unsigned short* full, int size)
+{
+    int block = 1 << compact_shift;
+    int error = 0;
+    for (int i = 0; i < size; i += block) {
+        int dv;
+        if (i + block < size) {
+            dv = full[i + block] - full[i];
+        }
+        else {
+            // Extrapolate the slope of the last block.
+            dv = (full[size - 1] - full[i])*block/(block - 1);
+        }
+        compact_t& c = table[i >> compact_shift];
+        c.v = full[i];
+        c.dv = (short)std::max(-32768, std::min(32767, dv));
+
+        for (int j = i; j < i + block; j++) {
+            error = std::max(error, std::abs(compact_lookup(table, j) - full[j]));
+        }
+    }
+    return error;
+}
+
+int Filter::compact_error(chip_model model)
+{
+    init_model_filter(model);
+    return model_filter[model].compact_error;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Table cache.
+// The lookup tables of a chip model (and the VCR tables of the MOS6581) are
+// stored as raw memory together with a header that identifies the build
+// parameters of the tables (table_cache_key()) and a checksum. A cache that
+// does not match is rebuilt.
+// ----------------------------------------------------------------------------
+void Filter::set_table_cache(const char* dir)
+{
+    table_cache_dir = dir ? dir : "";
+}
+
+static std::string table_cache_path(chip_model model)
+{
+    return table_cache_dir + "/resid_filter_" + (model == MOS6581 ? "6581" : "8580") + ".bin";
+}
+
+// A temporary file name next to the cache that no other writer uses: the
+// time, the thread and a count of the names taken in this process. Only
+// standard C++, as there is no portable process id.
+static std::string table_cache_temp_path(const std::string& path)
+{
+    static std::atomic<unsigned int> count(0);
+    unsigned long long unique =
+        (unsigned long long)std::chrono::high_resolution_clock::now().time_since_epoch().count()
+        ^ ((unsigned long long)std::hash<std::thread::id>()(std::this_thread::get_id()) << 20);
+    char name[48];
+    snprintf(name, sizeof(name), ".%llx.%x.tmp", unique, count++);
+    return path + name;
+}
+
+// The tables of a model: model_filter and for the MOS6581 the VCR tables.
+static int table_cache_blocks(chip_model model, void** data, int* size,
+                              void* mf, int mf_size, void* kVg, void* n_Ids_term)
+{
+    data[0] = mf;
+    size[0] = mf_size;
+    if (model != MOS6581) {
+        return 1;
+    }
+    data[1] = kVg;
+    size[1] = sizeof(unsigned short) << 16;
+    data[2] = n_Ids_term;
+    size[2] = sizeof(unsigned short) << 16;
+    return 3;
+}
+
+static unsigned int table_cache_checksum(void** data, int* size, int n)
+{
+    // FNV-1a over 32 bit words.
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < n; i++) {
+        const unsigned int* words = (const unsigned int*)data[i];
+        for (int j = 0; j < size[i]/4; j++) {
+            hash = (hash ^ words[j])*16777619u;
+        }
+    }
+    return hash;
+}
+
+static unsigned int table_cache_hash(unsigned int hash, const void* data, int size)
+{
+    // FNV-1a over bytes.
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (int i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i])*16777619u;
+    }
+    return hash;
+}
+
+// ----------------------------------------------------------------------------
+// Key of the build parameters of the tables of a model: the reSID version,
+// which changes with the code that solves the tables, the model parameters
+// and the table layout. Any change of them rebuilds the cache.
+// ----------------------------------------------------------------------------
+unsigned int Filter::table_cache_key(chip_model model)
+{
+    model_filter_init_t& fi = model_filter_init[model];
+    const double params[] = {
+        fi.voice_voltage_range, fi.voice_DC_voltage, fi.C, fi.Vdd, fi.Vth, fi.Ut,
+        fi.k, fi.uCox, fi.WL_vcr, fi.WL_snake, fi.dac_zero, fi.dac_scale,
+        fi.dac_2R_div_R
+    };
+    const int layout[] = {
+        NEW_8580_FILTER, RESID_COMPACT_FILTER, fi.dac_term, fi.opamp_voltage_size,
+        (int)sizeof(model_filter_t), summer_offset<5>::value, mixer_offset<8>::value,
+        (int)sizeof(vcr_kVg), (int)sizeof(vcr_n_Ids_term)
+    };
+
+    unsigned int key = 2166136261u;
+    key = table_cache_hash(key, resid_version_string, strlen(resid_version_string));
+    key = table_cache_hash(key, fi.opamp_voltage, fi.opamp_voltage_size*sizeof(double_point));
+    key = table_cache_hash(key, params, sizeof(params));
+    key = table_cache_hash(key, layout, sizeof(layout));
+    return key;
+}
+
+static void table_cache_init_header(table_cache_header_t& header, chip_model model,
+                                    unsigned int key, int size, unsigned int checksum)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "reSIDflt", 8);
+    header.key = key;
+    header.model = model;
+    header.size = size;
+    header.checksum = checksum;
+}
+
+bool Filter::read_table_cache(chip_model model)
+{
+    if (table_cache_dir.empty()) {
+        return false;
+    }
+
+    void* data[3];
+    int size[3];
+    int n = table_cache_blocks(model, data, size, &model_filter[model],
+                               sizeof(model_filter_t), vcr_kVg, vcr_n_Ids_term);
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        total += size[i];
+    }
+
+    FILE* f = fopen(table_cache_path(model).c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    table_cache_header_t header, expected;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1;
+    for (int i = 0; ok && i < n; i++) {
+        ok = fread(data[i], size[i], 1, f) == 1;
+    }
+    ok = ok && fgetc(f) == EOF;
+    fclose(f);
+
+    // The checksum guards against truncated or otherwise damaged files.
+    if (ok) {
+        table_cache_init_header(expected, model, table_cache_key(model), total,
+                                table_cache_checksum(data, size, n));
+        ok = memcmp(&header, &expected, sizeof(header)) == 0;
+    }
+    return ok;
+}
+
+void Filter::write_table_cache(chip_model model)
+{
+    if (table_cache_dir.empty()) {
+        return;
+    }
+
+    void* data[3];
+    int size[3];
+    int n = table_cache_blocks(model, data, size, &model_filter[model],
+                               sizeof(model_filter_t), vcr_kVg, vcr_n_Ids_term);
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        total += size[i];
+    }
+    table_cache_header_t header;
+    table_cache_init_header(header, model, table_cache_key(model), total,
+                            table_cache_checksum(data, size, n));
+
+    // Write a temporary file of a unique name first, so neither a concurrent
+    // reader nor another process writing the cache sees a partial file.
+    // Failures only mean that the tables are built again.
+    std::string path = table_cache_path(model);
+    std::string tmp = table_cache_temp_path(path);
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (int i = 0; ok && i < n; i++) {
+        ok = fwrite(data[i], size[i], 1, f) == 1;
+    }
+    ok = fclose(f) == 0 && ok;
+    // rename() replaces an existing cache atomically, except on systems
+    // that refuse to replace it.
+    if (ok && rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(path.c_str());
+        ok = rename(tmp.c_str(), path.c_str()) == 0;
+    }
+    if (!ok) {
+        remove(tmp.c_str());
+    }
+}
+
+void Filter::build_vcr_tables()
+{
+    model_filter_init_t& fi = model_filter_init[0];
+
+    double N16 = model_filter[0].vo_N16;
+    double vmin = N16*fi.opamp_voltage[0][0];
+    double k = fi.k;
+    double kVddt = N16*(k*(fi.Vdd - fi.Vth));
+
+    for (int i = 0; i < (1 << 16); i++) {
+        // The table index is right-shifted 16 times in order to fit in
+        // 16 bits; the argument to sqrt is thus multiplied by (1 << 16).
+        //
+        // The returned value must be corrected for translation. Vg always
+        // takes part in a subtraction as follows:
+        //
+        //   k*Vg - Vx = (k*Vg - t) - (Vx - t)
+        //
+        // I.e. k*Vg - t must be returned.
+        double Vg = kVddt - sqrt((double)i*(1 << 16));
+        vcr_kVg[i] = (unsigned short)(k*Vg - vmin + 0.5);
+    }
+
+    /*
+    EKV model:
+
+    Ids = Is*(if - ir)
+    Is = 2*u*Cox*Ut^2/k*W/L
+    if = ln^2(1 + e^((k*(Vg - Vt) - Vs)/(2*Ut))
+    ir = ln^2(1 + e^((k*(Vg - Vt) - Vd)/(2*Ut))
+    */
+    double kVt = fi.k*fi.Vth;
+    double Ut = fi.Ut;
+    double Is = 2*fi.uCox*Ut*Ut/fi.k*fi.WL_vcr;
+    // Normalized current factor for 1 cycle at 1MHz.
+    double N15 = N16/2;
+    double n_Is = N15*1.0e-6/fi.C*Is;
+
+    // kVg_Vx = k*Vg - Vx
+    // I.e. if k != 1.0, Vg must be scaled accordingly.
+    for (int kVg_Vx = 0; kVg_Vx < (1 << 16); kVg_Vx++) {
+        double log_term = log1p(exp((kVg_Vx/N16 - kVt)/(2*Ut)));
+        // Scaled by m*2^15
+        vcr_n_Ids_term[kVg_Vx] = (unsigned short)(n_Is*log_term*log_term);
+    }
 }
 
 
@@ -451,6 +780,7 @@ void Filter::enable_filter(bool enable)
 // ----------------------------------------------------------------------------
 void Filter::adjust_filter_bias(double dac_bias)
 {
+    select_pending_model();
     Vw_bias = int(dac_bias*model_filter[sid_model].vo_N16);
     set_w0();
 }
@@ -460,6 +790,9 @@ void Filter::adjust_filter_bias(double dac_bias)
 // ----------------------------------------------------------------------------
 void Filter::set_chip_model(chip_model model)
 {
+    init_model_filter(model);
+    model_pending = false;
+
     sid_model = model;
     /* We initialize the state variables again just to make sure that
     * the earlier model didn't leave behind some foreign, unrecoverable
@@ -468,6 +801,17 @@ void Filter::set_chip_model(chip_model model)
     Vhp = 0;
     Vbp = Vbp_x = Vbp_vc = 0;
     Vlp = Vlp_x = Vlp_vc = 0;
+
+    // Values derived from the model tables.
+    input(ext_in);
+    set_w0();
+}
+
+void Filter::select_pending_model()
+{
+    if (unlikely(model_pending)) {
+        set_chip_model(sid_model);
+    }
 }
 
 
@@ -488,6 +832,8 @@ void Filter::set_voice_mask(reg4 mask)
 // ----------------------------------------------------------------------------
 void Filter::reset()
 {
+    select_pending_model();
+
     fc = 0;
     res = 0;
     filt = 0;
@@ -509,18 +855,21 @@ void Filter::reset()
 // ----------------------------------------------------------------------------
 void Filter::writeFC_LO(reg8 fc_lo)
 {
+    select_pending_model();
     fc = (fc & 0x7f8) | (fc_lo & 0x007);
     set_w0();
 }
 
 void Filter::writeFC_HI(reg8 fc_hi)
 {
+    select_pending_model();
     fc = ((fc_hi << 3) & 0x7f8) | (fc & 0x007);
     set_w0();
 }
 
 void Filter::writeRES_FILT(reg8 res_filt)
 {
+    select_pending_model();
     res = (res_filt >> 4) & 0x0f;
     set_Q();
 
@@ -530,6 +879,7 @@ void Filter::writeRES_FILT(reg8 res_filt)
 
 void Filter::writeMODE_VOL(reg8 mode_vol)
 {
+    select_pending_model();
     mode = mode_vol & 0xf0;
     set_sum_mix();
 
@@ -369,10 +369,25 @@ public:
   // SID audio output (16 bits).
   short output();
 
+#if RESID_COMPACT_FILTER
+  // Largest deviation of the interpolated op-amp tables of a chip model from
+  // the full tables, in 16 bit table steps.
+  static int compact_error(chip_model model);
+#endif
+
+  // Directory for caching the lookup tables of the chip models, so they are
+  // only built once and loaded from there afterwards. Must be set before the
+  // first filter selects a chip model, null or empty disables the cache.
+  static void set_table_cache(const char* dir);
+
 protected:
   void set_sum_mix();
   void set_w0();
   void set_Q();
+  void select_pending_model();
+
+  // Lookup tables of the current model are not built yet.
+  bool model_pending;
 
   // Filter enabled.
   bool enabled;
@@ -408,6 +423,7 @@ protected:
   int Vlp; // lowpass
   int Vlp_x, Vlp_vc;
   // Filter / mixer inputs.
+  short ext_in;
   int ve;
   int v3;
   int v2;
@@ -427,6 +443,26 @@ protected:
     short dvx;
   } opamp_t;
 
+#if RESID_COMPACT_FILTER
+  // A compact table stores the first entry of every block of
+  // 1 << compact_shift entries and the slope to the next block. The mixer
+  // table is padded in front, so that each of its input configurations
+  // starts on a block like the summer configurations do.
+  enum {
+    compact_shift = RESID_COMPACT_FILTER,
+    compact_mask = (1 << RESID_COMPACT_FILTER) - 1,
+    mixer_pad = (1 << RESID_COMPACT_FILTER) - 1
+  };
+
+  typedef struct {
+    unsigned short v;
+    short dv;
+  } compact_t;
+
+  static int compact_lookup(const compact_t* table, int i);
+  static int build_compact_table(compact_t* table, const unsigned short* full, int size);
+#endif
+
   typedef struct {
     int vo_N16;  // Fixed point scaling for 16 bit op-amp output.
     int kVddt;   // K*(Vdd - Vth)
@@ -440,15 +476,36 @@ protected:
 
     // Reverse op-amp transfer function.
     unsigned short opamp_rev[1 << 16];
+#if RESID_COMPACT_FILTER
+    // Interpolated lookup tables for gain and summer op-amps in output
+    // stage / filter, see compact_lookup().
+    compact_t summer[summer_offset<5>::value >> compact_shift];
+    compact_t gain[16][(1 << 16) >> compact_shift];
+    compact_t mixer[(mixer_offset<8>::value + mixer_pad) >> compact_shift];
+    int compact_error;
+#else
     // Lookup tables for gain and summer op-amps in output stage / filter.
     unsigned short summer[summer_offset<5>::value];
     unsigned short gain[16][1 << 16];
     unsigned short mixer[mixer_offset<8>::value];
+#endif
     // Cutoff frequency DAC output voltage table. FC is an 11 bit register.
     unsigned short f0_dac[1 << 11];
   } model_filter_t;
 
-  int solve_gain(opamp_t* opamp, int n, int vi_t, int& x, model_filter_t& mf);
+  // Op-amp table lookups, interpolated with compact tables.
+  static int gain_lookup(model_filter_t& mf, int n8, int vi);
+  static int summer_lookup(model_filter_t& mf, int i);
+  static int mixer_lookup(model_filter_t& mf, int i);
+
+  static void init_model_filter(chip_model model);
+  static void load_model_filter(chip_model model);
+  static void build_model_filter(chip_model model);
+  static unsigned int table_cache_key(chip_model model);
+  static bool read_table_cache(chip_model model);
+  static void write_table_cache(chip_model model);
+  static void build_vcr_tables();
+  static int solve_gain(opamp_t* opamp, int n, int vi_t, int& x, model_filter_t& mf);
   int solve_integrate_6581(int dt, int vi_t, int& x, int& vc, model_filter_t& mf);
 
   // VCR - 6581 only.
@@ -557,7 +614,7 @@ void Filter::clock(int voice1, int voice2, int voice3)
     // MOS 6581.
     Vlp = solve_integrate_6581(1, Vbp, Vlp_x, Vlp_vc, f);
     Vbp = solve_integrate_6581(1, Vhp, Vbp_x, Vbp_vc, f);
-    Vhp = f.summer[offset + f.gain[_8_div_Q][Vbp] + Vlp + Vi];
+    Vhp = summer_lookup(f, offset + gain_lookup(f, _8_div_Q, Vbp) + Vlp + Vi);
   }
   else {
     // MOS 8580. FIXME: Not yet using op-amp model.
@@ -678,7 +735,7 @@ void Filter::clock(cycle_count delta_t, int voice1, int voice2, int voice3)
       // Calculate filter outputs.
       Vlp = solve_integrate_6581(delta_t_flt, Vbp, Vlp_x, Vlp_vc, f);
       Vbp = solve_integrate_6581(delta_t_flt, Vhp, Vbp_x, Vbp_vc, f);
-      Vhp = f.summer[offset + f.gain[_8_div_Q][Vbp] + Vlp + Vi];
+      Vhp = summer_lookup(f, offset + gain_lookup(f, _8_div_Q, Vbp) + Vlp + Vi);
 
       delta_t -= delta_t_flt;
     }
@@ -725,7 +782,8 @@ void Filter::input(short sample)
   // input interface.
   // Note that the input is 16 bits, compared to the 20 bit voice output.
   model_filter_t& f = model_filter[sid_model];
-  ve = (sample*f.voice_scale_s14*3 >> 14) + f.mixer[0];
+  ext_in = sample;
+  ve = (sample*f.voice_scale_s14*3 >> 14) + mixer_lookup(f, 0);
 }
 
 
@@ -1277,7 +1335,7 @@ for my $mix (0..2**@i-1) {
 
   // Sum the inputs in the mixer and run the mixer output through the gain.
   if (sid_model == 0) {
-    return (short)(f.gain[vol][f.mixer[offset + Vi]] - (1 << 15));
+    return (short)(gain_lookup(f, vol, mixer_lookup(f, offset + Vi)) - (1 << 15));
   }
   else {
     // FIXME: Temporary code for MOS 8580, should use code above.
@@ -1575,6 +1633,55 @@ int Filter::solve_integrate_6581(int dt, int vi, int& vx, int& vc, model_filter_
   return vx + (vc >> 14);
 }
 
+
+// ----------------------------------------------------------------------------
+// Op-amp table lookups.
+// ----------------------------------------------------------------------------
+#if RESID_COMPACT_FILTER
+RESID_INLINE
+int Filter::compact_lookup(const compact_t* table, int i)
+{
+  const compact_t& c = table[i >> compact_shift];
+  return c.v + ((c.dv*(i & compact_mask) + (1 << (compact_shift - 1))) >> compact_shift);
+}
+
+RESID_INLINE
+int Filter::gain_lookup(model_filter_t& mf, int n8, int vi)
+{
+  return compact_lookup(mf.gain[n8], vi);
+}
+
+RESID_INLINE
+int Filter::summer_lookup(model_filter_t& mf, int i)
+{
+  return compact_lookup(mf.summer, i);
+}
+
+RESID_INLINE
+int Filter::mixer_lookup(model_filter_t& mf, int i)
+{
+  return compact_lookup(mf.mixer, i + mixer_pad);
+}
+#else
+RESID_INLINE
+int Filter::gain_lookup(model_filter_t& mf, int n8, int vi)
+{
+  return mf.gain[n8][vi];
+}
+
+RESID_INLINE
+int Filter::summer_lookup(model_filter_t& mf, int i)
+{
+  return mf.summer[i];
+}
+
+RESID_INLINE
+int Filter::mixer_lookup(model_filter_t& mf, int i)
+{
+  return mf.mixer[i];
+}
+#endif
+
 #endif // RESID_INLINING || defined(RESID_FILTER_CC)
 
 } // namespace reSID
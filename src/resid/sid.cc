@@ -25,7 +25,10 @@
 #endif
 
 #include "sid.h"
+#include "convolve.h"
 #include <math.h>
+#include <map>
+#include <mutex>
 
 #ifndef round
 #define round(x) (x>=0.0?floor(x+0.5):ceil(x-0.5))
@@ -56,9 +59,6 @@ SID::SID()
   fir = 0;
   fir_N = 0;
   fir_RES = 0;
-  fir_beta = 0;
-  fir_f_cycles_per_sample = 0;
-  fir_filter_scale = 0;
 
   sid_model = MOS6581;
   voice[0].set_sync_source(&voice[2]);
@@ -72,6 +72,8 @@ SID::SID()
   write_pipeline = 0;
 
   databus_ttl = 0;
+
+  idle = 0;
 }
 
 
@@ -81,7 +83,6 @@ SID::SID()
 SID::~SID()
 {
   delete[] sample;
-  delete[] fir;
 }
 
 
@@ -103,6 +104,7 @@ void SID::set_chip_model(chip_model model)
 
    */
   databus_ttl = sid_model == MOS8580 ? 0xa2000 : 0x1d00;
+  idle = 0;
 
   for (int i = 0; i < 3; i++) {
     voice[i].set_chip_model(model);
@@ -125,6 +127,7 @@ void SID::reset()
 
   bus_value = 0;
   bus_value_ttl = 0;
+  idle = 0;
 }
 
 
@@ -137,6 +140,7 @@ void SID::input(short sample)
 {
   // The input can be used to simulate the MOS8580 "digi boost" hardware hack.
   filter.input(sample);
+  idle = 0;
 }
 
 
@@ -191,6 +195,7 @@ void SID::write(reg8 offset, reg8 value)
   write_address = offset;
   bus_value = value;
   bus_value_ttl = databus_ttl;
+  idle = 0;
 
   if (unlikely(sampling == SAMPLE_FAST) && (sid_model == MOS8580)) {
     // Fake one cycle pipeline delay on the MOS8580
@@ -327,7 +332,28 @@ SID::State::State()
     envelope_state[i] = EnvelopeGenerator::RELEASE;
     hold_zero[i] = true;
     envelope_pipeline[i] = 0;
+
+    msb_rising[i] = false;
+    noise_output[i] = 0xfff;
+    tri_saw_pipeline[i] = 0x555;
+    osc3[i] = 0;
+    waveform_output[i] = 0;
+
+    envelope_next_state[i] = EnvelopeGenerator::RELEASE;
+    new_exponential_counter_period[i] = 0;
+    env3[i] = 0;
+    exponential_pipeline[i] = 0;
+    state_pipeline[i] = 0;
+    reset_rate_counter[i] = false;
   }
+
+  filter_Vhp = filter_Vbp = filter_Vbp_x = filter_Vbp_vc = 0;
+  filter_Vlp = filter_Vlp_x = filter_Vlp_vc = 0;
+  extfilt_Vlp = extfilt_Vhp = 0;
+  ext_in = 0;
+
+  sample_offset = 0;
+  sample_prev = sample_now = 0;
 }
 
 
@@ -337,6 +363,30 @@ SID::State::State()
 SID::State SID::read_state()
 {
   State state;
+  read_state(state);
+  return state;
+}
+
+
+// ----------------------------------------------------------------------------
+// Reserve the storage of the resampling samples of a state.
+// ----------------------------------------------------------------------------
+void SID::reserve_state(State& state)
+{
+  if (sample) {
+    state.sample.reserve(fir_N + 1 < RINGSIZE ? fir_N + 1 : RINGSIZE);
+  }
+}
+
+
+// ----------------------------------------------------------------------------
+// Read state into an existing state object.
+// The resampling samples are copied into the existing storage, so this does
+// not allocate memory once it was reserved with reserve_state() or the state
+// has been read with the same sampling parameters.
+// ----------------------------------------------------------------------------
+void SID::read_state(State& state)
+{
   int i, j;
 
   for (i = 0, j = 0; i < 3; i++, j += 7) {
@@ -391,9 +441,48 @@ SID::State SID::read_state()
     state.envelope_state[i] = voice[i].envelope.state;
     state.hold_zero[i] = voice[i].envelope.hold_zero;
     state.envelope_pipeline[i] = voice[i].envelope.envelope_pipeline;
+
+    state.msb_rising[i] = voice[i].wave.msb_rising;
+    state.noise_output[i] = voice[i].wave.noise_output;
+    state.tri_saw_pipeline[i] = voice[i].wave.tri_saw_pipeline;
+    state.osc3[i] = voice[i].wave.osc3;
+    state.waveform_output[i] = voice[i].wave.waveform_output;
+
+    state.envelope_next_state[i] = voice[i].envelope.next_state;
+    state.new_exponential_counter_period[i] = voice[i].envelope.new_exponential_counter_period;
+    state.env3[i] = voice[i].envelope.env3;
+    state.exponential_pipeline[i] = voice[i].envelope.exponential_pipeline;
+    state.state_pipeline[i] = voice[i].envelope.state_pipeline;
+    state.reset_rate_counter[i] = voice[i].envelope.reset_rate_counter;
   }
 
-  return state;
+  FilterState filter_integrators = filter_state();
+  state.filter_Vhp = filter_integrators.Vhp;
+  state.filter_Vbp = filter_integrators.Vbp;
+  state.filter_Vbp_x = filter_integrators.Vbp_x;
+  state.filter_Vbp_vc = filter_integrators.Vbp_vc;
+  state.filter_Vlp = filter_integrators.Vlp;
+  state.filter_Vlp_x = filter_integrators.Vlp_x;
+  state.filter_Vlp_vc = filter_integrators.Vlp_vc;
+  state.extfilt_Vlp = filter_integrators.ext_Vlp;
+  state.extfilt_Vhp = filter_integrators.ext_Vhp;
+  state.ext_in = filter.ext_in;
+
+  state.sample_offset = sample_offset;
+  state.sample_prev = sample_prev;
+  state.sample_now = sample_now;
+
+  // The FIR filter convolves the last fir_N + 1 samples at most.
+  if (sample) {
+    int n = fir_N + 1 < RINGSIZE ? fir_N + 1 : RINGSIZE;
+    state.sample.resize(n);
+    for (j = 0; j < n; j++) {
+      state.sample[j] = sample[(sample_index - n + j) & RINGMASK];
+    }
+  }
+  else {
+    state.sample.clear();
+  }
 }
 
 
@@ -404,8 +493,12 @@ void SID::write_state(const State& state)
 {
   int i;
 
+  // Write the registers directly, write(offset, value) only pipelines
+  // them on the MOS8580 with SAMPLE_FAST.
   for (i = 0; i <= 0x18; i++) {
-    write(i, state.sid_register[i]);
+    write_address = i;
+    bus_value = state.sid_register[i];
+    write();
   }
 
   bus_value = state.bus_value;
@@ -413,6 +506,7 @@ void SID::write_state(const State& state)
   write_pipeline = state.write_pipeline;
   write_address = state.write_address;
   filter.set_voice_mask(state.voice_mask);
+  idle = 0;
 
   for (i = 0; i < 3; i++) {
     voice[i].wave.accumulator = state.accumulator[i];
@@ -430,7 +524,287 @@ void SID::write_state(const State& state)
     voice[i].envelope.state = state.envelope_state[i];
     voice[i].envelope.hold_zero = state.hold_zero[i];
     voice[i].envelope.envelope_pipeline = state.envelope_pipeline[i];
+
+    voice[i].wave.msb_rising = state.msb_rising[i];
+    voice[i].wave.noise_output = state.noise_output[i];
+    voice[i].wave.no_noise_or_noise_output =
+      voice[i].wave.no_noise | voice[i].wave.noise_output;
+    voice[i].wave.tri_saw_pipeline = state.tri_saw_pipeline[i];
+    voice[i].wave.osc3 = state.osc3[i];
+    voice[i].wave.waveform_output = state.waveform_output[i];
+
+    voice[i].envelope.next_state = state.envelope_next_state[i];
+    voice[i].envelope.new_exponential_counter_period = state.new_exponential_counter_period[i];
+    voice[i].envelope.env3 = state.env3[i];
+    voice[i].envelope.exponential_pipeline = state.exponential_pipeline[i];
+    voice[i].envelope.state_pipeline = state.state_pipeline[i];
+    voice[i].envelope.reset_rate_counter = state.reset_rate_counter[i];
+  }
+
+  filter.Vhp = state.filter_Vhp;
+  filter.Vbp = state.filter_Vbp;
+  filter.Vbp_x = state.filter_Vbp_x;
+  filter.Vbp_vc = state.filter_Vbp_vc;
+  filter.Vlp = state.filter_Vlp;
+  filter.Vlp_x = state.filter_Vlp_x;
+  filter.Vlp_vc = state.filter_Vlp_vc;
+  extfilt.Vlp = state.extfilt_Vlp;
+  extfilt.Vhp = state.extfilt_Vhp;
+  filter.input(state.ext_in);
+
+  sample_offset = state.sample_offset;
+  sample_prev = state.sample_prev;
+  sample_now = state.sample_now;
+
+  // Restore the newest samples of the ring, older ones are silence.
+  if (sample) {
+    int n = int(state.sample.size()) < RINGSIZE ? int(state.sample.size()) : RINGSIZE;
+    const short* last = state.sample.data() + state.sample.size() - n;
+    for (i = 0; i < RINGSIZE; i++) {
+      sample[i] = sample[i + RINGSIZE] = 0;
+    }
+    for (i = 0; i < n; i++) {
+      int j = (sample_index - n + i) & RINGMASK;
+      sample[j] = sample[j + RINGSIZE] = last[i];
+    }
+  }
+}
+
+
+// ----------------------------------------------------------------------------
+// Serialize state.
+// All values are stored as 32 bit little endian integers, the samples of the
+// resampling ring as 16 bit, preceded by the version.
+// ----------------------------------------------------------------------------
+namespace {
+
+class StateWriter
+{
+public:
+  StateWriter(std::vector<unsigned char>& data) : data(data) {}
+
+  void put(int value, int bytes = 4)
+  {
+    for (int i = 0; i < bytes; i++) {
+      data.push_back((unsigned(value) >> (i*8)) & 0xff);
+    }
+  }
+
+  template<class T>
+  void put(const T* values, int n)
+  {
+    for (int i = 0; i < n; i++) {
+      put(int(values[i]));
+    }
+  }
+
+private:
+  std::vector<unsigned char>& data;
+};
+
+class StateReader
+{
+public:
+  StateReader(const unsigned char* data, size_t size) :
+    data(data), size(size), pos(0), error(false) {}
+
+  int get(int bytes = 4)
+  {
+    if (pos + bytes > size) {
+      error = true;
+      return 0;
+    }
+    unsigned value = 0;
+    for (int i = 0; i < bytes; i++) {
+      value |= unsigned(data[pos++]) << (i*8);
+    }
+    // Sign extend 16 bit values.
+    return bytes == 2 ? int(short(value)) : int(value);
+  }
+
+  template<class T>
+  void get(T* values, int n)
+  {
+    for (int i = 0; i < n; i++) {
+      values[i] = T(get());
+    }
+  }
+
+  const unsigned char* data;
+  size_t size;
+  size_t pos;
+  bool error;
+};
+
+}
+
+std::vector<unsigned char> SID::State::serialize() const
+{
+  std::vector<unsigned char> data;
+  StateWriter out(data);
+
+  out.put(STATE_VERSION);
+  out.put(sid_register, 0x20);
+
+  out.put(bus_value);
+  out.put(bus_value_ttl);
+  out.put(write_pipeline);
+  out.put(write_address);
+  out.put(voice_mask);
+
+  out.put(accumulator, 3);
+  out.put(shift_register, 3);
+  out.put(shift_register_reset, 3);
+  out.put(shift_pipeline, 3);
+  out.put(pulse_output, 3);
+  out.put(floating_output_ttl, 3);
+
+  out.put(rate_counter, 3);
+  out.put(rate_counter_period, 3);
+  out.put(exponential_counter, 3);
+  out.put(exponential_counter_period, 3);
+  out.put(envelope_counter, 3);
+  out.put(envelope_state, 3);
+  out.put(hold_zero, 3);
+  out.put(envelope_pipeline, 3);
+
+  out.put(msb_rising, 3);
+  out.put(noise_output, 3);
+  out.put(tri_saw_pipeline, 3);
+  out.put(osc3, 3);
+  out.put(waveform_output, 3);
+
+  out.put(envelope_next_state, 3);
+  out.put(new_exponential_counter_period, 3);
+  out.put(env3, 3);
+  out.put(exponential_pipeline, 3);
+  out.put(state_pipeline, 3);
+  out.put(reset_rate_counter, 3);
+
+  out.put(filter_Vhp);
+  out.put(filter_Vbp);
+  out.put(filter_Vbp_x);
+  out.put(filter_Vbp_vc);
+  out.put(filter_Vlp);
+  out.put(filter_Vlp_x);
+  out.put(filter_Vlp_vc);
+  out.put(extfilt_Vlp);
+  out.put(extfilt_Vhp);
+  out.put(ext_in);
+
+  out.put(sample_offset);
+  out.put(sample_prev);
+  out.put(sample_now);
+  out.put(int(sample.size()));
+  for (size_t i = 0; i < sample.size(); i++) {
+    out.put(sample[i], 2);
+  }
+
+  return data;
+}
+
+
+// ----------------------------------------------------------------------------
+// Deserialize state.
+// ----------------------------------------------------------------------------
+bool SID::State::deserialize(const unsigned char* data, size_t size)
+{
+  StateReader in(data, size);
+  State state;
+
+  if (in.get() != STATE_VERSION) {
+    return false;
+  }
+  in.get(state.sid_register, 0x20);
+
+  state.bus_value = in.get();
+  state.bus_value_ttl = in.get();
+  state.write_pipeline = in.get();
+  state.write_address = in.get();
+  state.voice_mask = in.get();
+
+  in.get(state.accumulator, 3);
+  in.get(state.shift_register, 3);
+  in.get(state.shift_register_reset, 3);
+  in.get(state.shift_pipeline, 3);
+  in.get(state.pulse_output, 3);
+  in.get(state.floating_output_ttl, 3);
+
+  in.get(state.rate_counter, 3);
+  in.get(state.rate_counter_period, 3);
+  in.get(state.exponential_counter, 3);
+  in.get(state.exponential_counter_period, 3);
+  in.get(state.envelope_counter, 3);
+  // Enums are range checked before they are converted.
+  int envelope_state[3];
+  in.get(envelope_state, 3);
+  in.get(state.hold_zero, 3);
+  in.get(state.envelope_pipeline, 3);
+
+  in.get(state.msb_rising, 3);
+  in.get(state.noise_output, 3);
+  in.get(state.tri_saw_pipeline, 3);
+  in.get(state.osc3, 3);
+  in.get(state.waveform_output, 3);
+
+  int envelope_next_state[3];
+  in.get(envelope_next_state, 3);
+  in.get(state.new_exponential_counter_period, 3);
+  in.get(state.env3, 3);
+  in.get(state.exponential_pipeline, 3);
+  in.get(state.state_pipeline, 3);
+  in.get(state.reset_rate_counter, 3);
+
+  state.filter_Vhp = in.get();
+  state.filter_Vbp = in.get();
+  state.filter_Vbp_x = in.get();
+  state.filter_Vbp_vc = in.get();
+  state.filter_Vlp = in.get();
+  state.filter_Vlp_x = in.get();
+  state.filter_Vlp_vc = in.get();
+  state.extfilt_Vlp = in.get();
+  state.extfilt_Vhp = in.get();
+  state.ext_in = short(in.get());
+
+  state.sample_offset = in.get();
+  state.sample_prev = short(in.get());
+  state.sample_now = short(in.get());
+  int n = in.get();
+  if (n < 0 || n > RINGSIZE) {
+    return false;
+  }
+  state.sample.resize(n);
+  for (int i = 0; i < n; i++) {
+    state.sample[i] = short(in.get(2));
+  }
+
+  // Reject truncated data, out of range enum values and register values
+  // wider than their register, which would index the waveform, envelope
+  // and DAC tables out of bounds.
+  if (in.error || in.pos != size) {
+    return false;
+  }
+  for (int i = 0; i < 3; i++) {
+    if (envelope_state[i] < EnvelopeGenerator::ATTACK ||
+        envelope_state[i] > EnvelopeGenerator::FREEZED ||
+        envelope_next_state[i] < EnvelopeGenerator::ATTACK ||
+        envelope_next_state[i] > EnvelopeGenerator::FREEZED) {
+      return false;
+    }
+    if (state.accumulator[i] > 0xffffff ||
+        state.tri_saw_pipeline[i] > 0xfff ||
+        state.osc3[i] > 0xfff ||
+        state.waveform_output[i] > 0xfff ||
+        state.envelope_counter[i] > 0xff ||
+        state.env3[i] > 0xff) {
+      return false;
+    }
+    state.envelope_state[i] = EnvelopeGenerator::State(envelope_state[i]);
+    state.envelope_next_state[i] = EnvelopeGenerator::State(envelope_next_state[i]);
   }
+
+  *this = state;
+  return true;
 }
 
 
@@ -442,6 +816,7 @@ void SID::write_state(const State& state)
 void SID::set_voice_mask(reg4 mask)
 {
   filter.set_voice_mask(mask);
+  idle = 0;
 }
 
 
@@ -451,6 +826,7 @@ void SID::set_voice_mask(reg4 mask)
 void SID::enable_filter(bool enable)
 {
   filter.enable_filter(enable);
+  idle = 0;
 }
 
 
@@ -462,6 +838,7 @@ void SID::enable_filter(bool enable)
 // ----------------------------------------------------------------------------
 void SID::adjust_filter_bias(double dac_bias) {
   filter.adjust_filter_bias(dac_bias);
+  idle = 0;
 }
 
 
@@ -471,6 +848,7 @@ void SID::adjust_filter_bias(double dac_bias) {
 void SID::enable_external_filter(bool enable)
 {
   extfilt.enable_filter(enable);
+  idle = 0;
 }
 
 
@@ -566,8 +944,8 @@ bool SID::set_sampling_parameters(double clock_freq, sampling_method method,
   if (method != SAMPLE_RESAMPLE && method != SAMPLE_RESAMPLE_FASTMEM)
   {
     delete[] sample;
-    delete[] fir;
     sample = 0;
+    fir_table.reset();
     fir = 0;
     return true;
   }
@@ -582,6 +960,86 @@ bool SID::set_sampling_parameters(double clock_freq, sampling_method method,
   }
   sample_index = 0;
 
+  // Look up shared FIR table.
+  fir_table = get_fir_table(clock_freq, method, sample_freq, pass_freq,
+                            filter_scale, fir_N, fir_RES);
+  fir = fir_table.get();
+
+  return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// Process wide cache of FIR tables.
+//
+// The FIR tables only depend on the sampling parameters, and for
+// SAMPLE_RESAMPLE_FASTMEM they take up several megabytes. All SID instances
+// using identical parameters therefore share one read-only table, which is
+// released when the last instance using it is reconfigured or destroyed.
+// ----------------------------------------------------------------------------
+namespace {
+
+struct FirKey
+{
+  double clock_freq;
+  double sample_freq;
+  double pass_freq;
+  double filter_scale;
+  sampling_method method;
+
+  bool operator<(const FirKey& other) const
+  {
+    if (clock_freq != other.clock_freq) return clock_freq < other.clock_freq;
+    if (sample_freq != other.sample_freq) return sample_freq < other.sample_freq;
+    if (pass_freq != other.pass_freq) return pass_freq < other.pass_freq;
+    if (filter_scale != other.filter_scale) return filter_scale < other.filter_scale;
+    return method < other.method;
+  }
+};
+
+struct FirEntry
+{
+  std::weak_ptr<const short> table;
+  int N;
+  int RES;
+};
+
+std::mutex fir_cache_mutex;
+std::map<FirKey, FirEntry> fir_cache;
+
+} // anonymous namespace
+
+
+std::shared_ptr<const short> SID::get_fir_table(double clock_freq,
+  sampling_method method, double sample_freq, double pass_freq,
+  double filter_scale, int& fir_N_out, int& fir_RES_out)
+{
+  FirKey key = { clock_freq, sample_freq, pass_freq, filter_scale, method };
+
+  // The lock is held while building, so concurrent requests for the same
+  // table only build it once.
+  std::lock_guard<std::mutex> lock(fir_cache_mutex);
+
+  std::map<FirKey, FirEntry>::iterator it = fir_cache.find(key);
+  if (it != fir_cache.end()) {
+    std::shared_ptr<const short> table = it->second.table.lock();
+    if (table) {
+      fir_N_out = it->second.N;
+      fir_RES_out = it->second.RES;
+      return table;
+    }
+  }
+
+  // Drop entries of tables no longer in use.
+  for (it = fir_cache.begin(); it != fir_cache.end();) {
+    if (it->second.table.expired()) {
+      fir_cache.erase(it++);
+    }
+    else {
+      ++it;
+    }
+  }
+
   const double pi = 3.1415926535897932385;
 
   // 16 bits -> -96dB stopband attenuation.
@@ -609,31 +1067,18 @@ bool SID::set_sampling_parameters(double clock_freq, sampling_method method,
 
   // The filter length is equal to the filter order + 1.
   // The filter length must be an odd number (sinc is symmetric about x = 0).
-  int fir_N_new = int(N*f_cycles_per_sample) + 1;
-  fir_N_new |= 1;
+  int fir_N = int(N*f_cycles_per_sample) + 1;
+  fir_N |= 1;
 
   // We clamp the filter table resolution to 2^n, making the fixed point
   // sample_offset a whole multiple of the filter table resolution.
   int res = method == SAMPLE_RESAMPLE ?
     FIR_RES : FIR_RES_FASTMEM;
   int n = (int)ceil(log(res/f_cycles_per_sample)/log(2.0f));
-  int fir_RES_new = 1 << n;
-
-  /* Determine if we need to recalculate table, or whether we can reuse earlier cached copy.
-   * This pays off on slow hardware such as current Android devices.
-   */
-  if (fir && fir_RES_new == fir_RES && fir_N_new == fir_N && beta == fir_beta && f_cycles_per_sample == fir_f_cycles_per_sample && fir_filter_scale == filter_scale) {
-      return true;
-  }
-  fir_RES = fir_RES_new;
-  fir_N = fir_N_new;
-  fir_beta = beta;
-  fir_f_cycles_per_sample = f_cycles_per_sample;
-  fir_filter_scale = filter_scale;
+  int fir_RES = 1 << n;
 
   // Allocate memory for FIR tables.
-  delete[] fir;
-  fir = new short[fir_N*fir_RES];
+  short* fir = new short[fir_N*fir_RES];
 
   // Calculate fir_RES FIR tables for linear interpolation.
   for (int i = 0; i < fir_RES; i++) {
@@ -652,7 +1097,15 @@ bool SID::set_sampling_parameters(double clock_freq, sampling_method method,
     }
   }
 
-  return true;
+  std::shared_ptr<const short> table(fir, std::default_delete<short[]>());
+  FirEntry& entry = fir_cache[key];
+  entry.table = table;
+  entry.N = fir_N;
+  entry.RES = fir_RES;
+
+  fir_N_out = fir_N;
+  fir_RES_out = fir_RES;
+  return table;
 }
 
 
@@ -688,6 +1141,7 @@ void SID::clock(cycle_count delta_t)
     write_pipeline = 0;
     clock(1);
     write();
+    idle = 0;
     delta_t -= 1;
   }
 
@@ -760,11 +1214,27 @@ void SID::clock(cycle_count delta_t)
     voice[i].wave.set_waveform_output(delta_t);
   }
 
+  if (unlikely(idle == delta_t)) {
+    // The filter and external filter would not change; skip them.
+    return;
+  }
+
+  // With all voices silent, the filter input is constant. If clocking
+  // leaves the filter state unchanged, so will every following clocking
+  // with the same delta_t until the next register write.
+  bool settle = voices_idle();
+  FilterState state;
+  if (unlikely(settle)) {
+    state = filter_state();
+  }
+
   // Clock filter.
   filter.clock(delta_t, voice[0].output(), voice[1].output(), voice[2].output());
 
   // Clock external filter.
   extfilt.clock(delta_t, filter.output());
+
+  idle = settle && state == filter_state() ? delta_t : 0;
 }
 
 
@@ -798,6 +1268,164 @@ int SID::clock(cycle_count& delta_t, short* buf, int n, int interleave)
 }
 
 
+// ----------------------------------------------------------------------------
+// Check whether all envelopes are held at zero, i.e. all voice outputs are
+// zero until the next register write.
+// ----------------------------------------------------------------------------
+bool SID::voices_idle()
+{
+  for (int i = 0; i < 3; i++) {
+    EnvelopeGenerator& envelope = voice[i].envelope;
+    if (!envelope.hold_zero || envelope.state_pipeline || envelope.output()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// Read the integrator state of the filter and external filter.
+// ----------------------------------------------------------------------------
+SID::FilterState SID::filter_state()
+{
+  FilterState state;
+  state.Vhp = filter.Vhp;
+  state.Vbp = filter.Vbp;
+  state.Vbp_x = filter.Vbp_x;
+  state.Vbp_vc = filter.Vbp_vc;
+  state.Vlp = filter.Vlp;
+  state.Vlp_x = filter.Vlp_x;
+  state.Vlp_vc = filter.Vlp_vc;
+  state.ext_Vlp = extfilt.Vlp;
+  state.ext_Vhp = extfilt.Vhp;
+  return state;
+}
+
+
+// ----------------------------------------------------------------------------
+// Clock the envelopes and oscillators n single cycles, n <= CLOCK_BATCH,
+// storing the envelope and waveform DAC outputs of each cycle.
+// The envelopes are independent of each other and of the oscillators.
+// The oscillators are coupled by sync and ring modulation and are clocked
+// together cycle by cycle.
+// ----------------------------------------------------------------------------
+void SID::clock_voices(short env_out[3][CLOCK_BATCH],
+                       short wave_out[3][CLOCK_BATCH], int n)
+{
+  int i, c;
+
+  // Clock amplitude modulators.
+  for (i = 0; i < 3; i++) {
+    voice[i].envelope.clock_batch(env_out[i], n);
+  }
+
+  // Clock and synchronize oscillators, calculate waveform output.
+  // Synchronization is a no-op unless a sync bit is set, and registers
+  // are not written within a batch.
+  bool sync = voice[0].wave.sync || voice[1].wave.sync || voice[2].wave.sync;
+  if (likely(!sync) && voice[0].wave.can_clock_batch(n) &&
+      voice[1].wave.can_clock_batch(n) && voice[2].wave.can_clock_batch(n)) {
+    // Without sync the oscillators only depend on each other for ring
+    // modulation, which reads the accumulator of the sync source.
+    reg24 accumulator[3];
+    reg24 freq[3];
+    for (i = 0; i < 3; i++) {
+      accumulator[i] = voice[i].wave.accumulator;
+      freq[i] = voice[i].wave.freq;
+    }
+    for (i = 0; i < 3; i++) {
+      int j = (i + 2) % 3;
+      voice[i].wave.clock_batch(wave_out[i], n, voice[i].wave_zero,
+                                accumulator[j], freq[j]);
+    }
+  }
+  else {
+    for (c = 0; c < n; c++) {
+      for (i = 0; i < 3; i++) {
+        voice[i].wave.clock();
+      }
+      if (unlikely(sync)) {
+        for (i = 0; i < 3; i++) {
+          voice[i].wave.synchronize();
+        }
+      }
+      for (i = 0; i < 3; i++) {
+        voice[i].wave.set_waveform_output();
+        wave_out[i][c] = voice[i].wave.output() - voice[i].wave_zero;
+      }
+    }
+  }
+
+}
+
+
+// ----------------------------------------------------------------------------
+// SID clocking - n single cycles, n <= CLOCK_BATCH.
+// This is equivalent to n calls of clock(), storing output() after each
+// cycle in out. Instead of interleaving all stages every cycle, each stage
+// is run for all cycles into small per-voice buffers: the voices first, see
+// clock_voices(), then the filter consumes the buffered voice outputs,
+// unless the SID is idle and the output is known to be constant.
+// ----------------------------------------------------------------------------
+void SID::clock_batch(int* out, int n)
+{
+  // Pipelined writes on the MOS8580 land after the first cycle.
+  if (unlikely(write_pipeline)) {
+    clock();
+    *out++ = output();
+    if (--n == 0) {
+      return;
+    }
+  }
+
+  short env_out[3][CLOCK_BATCH];
+  short wave_out[3][CLOCK_BATCH];
+  int c;
+
+  clock_voices(env_out, wave_out, n);
+
+  if (unlikely(idle == -1)) {
+    // The filter and external filter would not change; skip them.
+    int value = extfilt.output();
+    for (c = 0; c < n; c++) {
+      out[c] = value;
+    }
+  }
+  else {
+    // Clock filter and external filter.
+    for (c = 0; c < n - 1; c++) {
+      filter.clock(wave_out[0][c]*env_out[0][c], wave_out[1][c]*env_out[1][c],
+                   wave_out[2][c]*env_out[2][c]);
+      extfilt.clock(filter.output());
+      out[c] = extfilt.output();
+    }
+
+    // With all voices silent, the filter input is constant. If the last
+    // cycle leaves the filter state unchanged, so will every following
+    // cycle until the next register write.
+    bool settle = voices_idle();
+    FilterState state;
+    if (unlikely(settle)) {
+      state = filter_state();
+    }
+
+    filter.clock(wave_out[0][c]*env_out[0][c], wave_out[1][c]*env_out[1][c],
+                 wave_out[2][c]*env_out[2][c]);
+    extfilt.clock(filter.output());
+    out[c] = extfilt.output();
+
+    idle = settle && state == filter_state() ? -1 : 0;
+  }
+
+  // Age bus value.
+  if (unlikely(bus_value_ttl > 0 && bus_value_ttl <= n)) {
+    bus_value = 0;
+  }
+  bus_value_ttl -= n;
+}
+
+
 // ----------------------------------------------------------------------------
 // SID clocking with audio sampling - delta clocking picking nearest sample.
 // ----------------------------------------------------------------------------
@@ -849,12 +1477,11 @@ int SID::clock_interpolate(cycle_count& delta_t, short* buf, int n, int interlea
       delta_t_sample = delta_t;
     }
 
-    for (int i = delta_t_sample; i > 0; i--) {
-      clock();
-      if (unlikely(i <= 2)) {
-        sample_prev = sample_now;
-        sample_now = output();
-      }
+    for (int i = delta_t_sample; i > 0; i -= CLOCK_BATCH) {
+      int out[CLOCK_BATCH];
+      int batch = i < CLOCK_BATCH ? i : CLOCK_BATCH;
+      clock_batch(out, batch);
+      interpolate_batch(out, batch, i);
     }
 
     if ((delta_t -= delta_t_sample) == 0) {
@@ -864,13 +1491,29 @@ int SID::clock_interpolate(cycle_count& delta_t, short* buf, int n, int interlea
 
     sample_offset = next_sample_offset & FIXP_MASK;
 
-    buf[s*interleave] =
-      sample_prev + (sample_offset*(sample_now - sample_prev) >> FIXP_SHIFT);
+    buf[s*interleave] = interpolate_output();
   }
 
   return s;
 }
 
+// Keep the output of the last two cycles of a sample, i is the number of
+// cycles left in the sample including the batch.
+void SID::interpolate_batch(const int* out, int batch, int i)
+{
+  for (int c = batch - 2 < 0 ? 0 : batch - 2; c < batch; c++) {
+    if (unlikely(i - c <= 2)) {
+      sample_prev = sample_now;
+      sample_now = out[c];
+    }
+  }
+}
+
+short SID::interpolate_output()
+{
+  return sample_prev + (sample_offset*(sample_now - sample_prev) >> FIXP_SHIFT);
+}
+
 
 // ----------------------------------------------------------------------------
 // SID clocking with audio sampling - cycle based with audio resampling.
@@ -920,10 +1563,11 @@ int SID::clock_resample(cycle_count& delta_t, short* buf, int n, int interleave)
       delta_t_sample = delta_t;
     }
 
-    for (int i = 0; i < delta_t_sample; i++) {
-      clock();
-      sample[sample_index] = sample[sample_index + RINGSIZE] = clip(output());
-      ++sample_index &= RINGMASK;
+    for (int i = 0; i < delta_t_sample; i += CLOCK_BATCH) {
+      int out[CLOCK_BATCH];
+      int batch = delta_t_sample - i < CLOCK_BATCH ? delta_t_sample - i : CLOCK_BATCH;
+      clock_batch(out, batch);
+      resample_batch(out, batch);
     }
 
     if ((delta_t -= delta_t_sample) == 0) {
@@ -933,42 +1577,50 @@ int SID::clock_resample(cycle_count& delta_t, short* buf, int n, int interleave)
 
     sample_offset = next_sample_offset & FIXP_MASK;
 
-    int fir_offset = sample_offset*fir_RES >> FIXP_SHIFT;
-    int fir_offset_rmd = sample_offset*fir_RES & FIXP_MASK;
-    short* fir_start = fir + fir_offset*fir_N;
-    short* sample_start = sample + sample_index - fir_N - 1 + RINGSIZE;
+    buf[s*interleave] = resample_output();
+  }
 
-    // Convolution with filter impulse response.
-    int v1 = 0;
-    for (int j = 0; j < fir_N; j++) {
-      v1 += sample_start[j]*fir_start[j];
-    }
+  return s;
+}
 
-    // Use next FIR table, wrap around to first FIR table using
-    // next sample.
-    if (unlikely(++fir_offset == fir_RES)) {
-      fir_offset = 0;
-      ++sample_start;
-    }
-    fir_start = fir + fir_offset*fir_N;
+// Store the output of each cycle in the sample ring buffer.
+void SID::resample_batch(const int* out, int batch)
+{
+  for (int c = 0; c < batch; c++) {
+    sample[sample_index] = sample[sample_index + RINGSIZE] = clip(out[c]);
+    ++sample_index &= RINGMASK;
+  }
+}
 
-    // Convolution with filter impulse response.
-    int v2 = 0;
-    for (int k = 0; k < fir_N; k++) {
-      v2 += sample_start[k]*fir_start[k];
-    }
+short SID::resample_output()
+{
+  int fir_offset = sample_offset*fir_RES >> FIXP_SHIFT;
+  int fir_offset_rmd = sample_offset*fir_RES & FIXP_MASK;
+  const short* fir_start = fir + fir_offset*fir_N;
+  short* sample_start = sample + sample_index - fir_N - 1 + RINGSIZE;
+
+  // Convolution with filter impulse response.
+  int v1 = convolve(sample_start, fir_start, fir_N);
+
+  // Use next FIR table, wrap around to first FIR table using
+  // next sample.
+  if (unlikely(++fir_offset == fir_RES)) {
+    fir_offset = 0;
+    ++sample_start;
+  }
+  fir_start = fir + fir_offset*fir_N;
 
-    // Linear interpolation.
-    // fir_offset_rmd is equal for all samples, it can thus be factorized out:
-    // sum(v1 + rmd*(v2 - v1)) = sum(v1) + rmd*(sum(v2) - sum(v1))
-    int v = v1 + int((unsigned(fir_offset_rmd)*unsigned(v2 - v1)) >> FIXP_SHIFT);
+  // Convolution with filter impulse response.
+  int v2 = convolve(sample_start, fir_start, fir_N);
 
-    v >>= FIR_SHIFT;
+  // Linear interpolation.
+  // fir_offset_rmd is equal for all samples, it can thus be factorized out:
+  // sum(v1 + rmd*(v2 - v1)) = sum(v1) + rmd*(sum(v2) - sum(v1))
+  int v = v1 + int((unsigned(fir_offset_rmd)*unsigned(v2 - v1)) >> FIXP_SHIFT);
 
-    buf[s*interleave] = clip(v);
-  }
+  v >>= FIR_SHIFT;
 
-  return s;
+  return clip(v);
 }
 
 
@@ -987,10 +1639,11 @@ int SID::clock_resample_fastmem(cycle_count& delta_t, short* buf, int n, int int
       delta_t_sample = delta_t;
     }
 
-    for (int i = 0; i < delta_t_sample; i++) {
-      clock();
-      sample[sample_index] = sample[sample_index + RINGSIZE] = output();
-      ++sample_index &= RINGMASK;
+    for (int i = 0; i < delta_t_sample; i += CLOCK_BATCH) {
+      int out[CLOCK_BATCH];
+      int batch = delta_t_sample - i < CLOCK_BATCH ? delta_t_sample - i : CLOCK_BATCH;
+      clock_batch(out, batch);
+      resample_fastmem_batch(out, batch);
     }
 
     if ((delta_t -= delta_t_sample) == 0) {
@@ -1000,22 +1653,32 @@ int SID::clock_resample_fastmem(cycle_count& delta_t, short* buf, int n, int int
 
     sample_offset = next_sample_offset & FIXP_MASK;
 
-    int fir_offset = sample_offset*fir_RES >> FIXP_SHIFT;
-    short* fir_start = fir + fir_offset*fir_N;
-    short* sample_start = sample + sample_index - fir_N + RINGSIZE;
-
-    // Convolution with filter impulse response.
-    int v = 0;
-    for (int j = 0; j < fir_N; j++) {
-      v += sample_start[j]*fir_start[j];
-    }
+    buf[s*interleave] = resample_fastmem_output();
+  }
 
-    v >>= FIR_SHIFT;
+  return s;
+}
 
-    buf[s*interleave] = clip(v);
+void SID::resample_fastmem_batch(const int* out, int batch)
+{
+  for (int c = 0; c < batch; c++) {
+    sample[sample_index] = sample[sample_index + RINGSIZE] = out[c];
+    ++sample_index &= RINGMASK;
   }
+}
 
-  return s;
+short SID::resample_fastmem_output()
+{
+  int fir_offset = sample_offset*fir_RES >> FIXP_SHIFT;
+  const short* fir_start = fir + fir_offset*fir_N;
+  short* sample_start = sample + sample_index - fir_N + RINGSIZE;
+
+  // Convolution with filter impulse response.
+  int v = convolve(sample_start, fir_start, fir_N);
+
+  v >>= FIR_SHIFT;
+
+  return clip(v);
 }
 
 } // namespace reSID
@@ -31,6 +31,8 @@
 #endif
 #include "extfilt.h"
 #include "pot.h"
+#include <memory>
+#include <vector>
 
 namespace reSID
 {
@@ -89,9 +91,47 @@ public:
     EnvelopeGenerator::State envelope_state[3];
     bool hold_zero[3];
     cycle_count envelope_pipeline[3];
+
+    // Version 1: the complete chip state.
+    // Waveform output and pipelines.
+    bool msb_rising[3];
+    reg16 noise_output[3];
+    reg12 tri_saw_pipeline[3];
+    reg12 osc3[3];
+    reg12 waveform_output[3];
+
+    // Envelope pipelines.
+    EnvelopeGenerator::State envelope_next_state[3];
+    reg8 new_exponential_counter_period[3];
+    reg8 env3[3];
+    cycle_count exponential_pipeline[3];
+    cycle_count state_pipeline[3];
+    bool reset_rate_counter[3];
+
+    // Filter and external filter integrators, EXT IN.
+    int filter_Vhp, filter_Vbp, filter_Vbp_x, filter_Vbp_vc;
+    int filter_Vlp, filter_Vlp_x, filter_Vlp_vc;
+    int extfilt_Vlp, extfilt_Vhp;
+    short ext_in;
+
+    // Resampling: the position within the current sample and the last
+    // samples used by the interpolation and the FIR filter, oldest first.
+    cycle_count sample_offset;
+    short sample_prev, sample_now;
+    std::vector<short> sample;
+
+    // Versioned little endian serialization for storing a state, e.g. in a
+    // file. deserialize() fails for data of an unknown version.
+    enum { STATE_VERSION = 1 };
+    std::vector<unsigned char> serialize() const;
+    bool deserialize(const unsigned char* data, size_t size);
   };
 
   State read_state();
+  void read_state(State& state);
+  // Reserve the sample storage of a state for the sampling parameters of
+  // this chip, so that read_state(state) copies into it without allocating.
+  void reserve_state(State& state);
   void write_state(const State& state);
 
   // 16-bit input (EXT IN).
@@ -102,10 +142,30 @@ public:
 
  protected:
   static double I0(double x);
+  static std::shared_ptr<const short> get_fir_table(double clock_freq,
+    sampling_method method, double sample_freq, double pass_freq,
+    double filter_scale, int& fir_N, int& fir_RES);
   int clock_fast(cycle_count& delta_t, short* buf, int n, int interleave);
   int clock_interpolate(cycle_count& delta_t, short* buf, int n, int interleave);
   int clock_resample(cycle_count& delta_t, short* buf, int n, int interleave);
   int clock_resample_fastmem(cycle_count& delta_t, short* buf, int n, int interleave);
+  void clock_batch(int* out, int n);
+  bool voices_idle();
+
+  // Integrator state of the filter and external filter.
+  struct FilterState
+  {
+    int Vhp, Vbp, Vbp_x, Vbp_vc, Vlp, Vlp_x, Vlp_vc;
+    int ext_Vlp, ext_Vhp;
+
+    bool operator==(const FilterState& s) const
+    {
+      return Vhp == s.Vhp && Vbp == s.Vbp && Vbp_x == s.Vbp_x &&
+        Vbp_vc == s.Vbp_vc && Vlp == s.Vlp && Vlp_x == s.Vlp_x &&
+        Vlp_vc == s.Vlp_vc && ext_Vlp == s.ext_Vlp && ext_Vhp == s.ext_Vhp;
+    }
+  };
+  FilterState filter_state();
   void write();
 
   chip_model sid_model;
@@ -125,6 +185,13 @@ public:
   cycle_count write_pipeline;
   reg8 write_address;
 
+  // All envelopes are held at zero and the filter and external filter have
+  // settled, i.e. the output is constant until the next register write.
+  // Nonzero only while idle, holding the filter step the state has settled
+  // for: -1 for single cycle clocking in clock_batch(), delta_t for
+  // clock(delta_t).
+  cycle_count idle;
+
   double clock_frequency;
 
   enum {
@@ -143,11 +210,28 @@ public:
     RINGSIZE = 1 << 14,
     RINGMASK = RINGSIZE - 1,
 
+    // Maximum number of single cycles clocked by clock_batch().
+    CLOCK_BATCH = 32,
+
     // Fixed point constants (16.16 bits).
     FIXP_SHIFT = 16,
     FIXP_MASK = 0xffff
   };
 
+  // The voice stage of clock_batch(), the only cycle clocking helper besides
+  // the public clock functions. SIDBank runs it for each chip of a bank,
+  // everything else clocks through clock() or clock_batch().
+  void clock_voices(short env_out[3][CLOCK_BATCH], short wave_out[3][CLOCK_BATCH], int n);
+
+  // Sampling of the cycle based methods: store the outputs of a batch
+  // clocked within the current sample and calculate the output sample.
+  void interpolate_batch(const int* out, int batch, int i);
+  short interpolate_output();
+  void resample_batch(const int* out, int batch);
+  short resample_output();
+  void resample_fastmem_batch(const int* out, int batch);
+  short resample_fastmem_output();
+
   // Sampling variables.
   sampling_method sampling;
   cycle_count cycles_per_sample;
@@ -156,15 +240,18 @@ public:
   short sample_prev, sample_now;
   int fir_N;
   int fir_RES;
-  double fir_beta;
-  double fir_f_cycles_per_sample;
-  double fir_filter_scale;
 
   // Ring buffer with overflow for contiguous storage of RINGSIZE samples.
   short* sample;
 
   // FIR_RES filter tables (FIR_N*FIR_RES).
-  short* fir;
+  // The tables are read-only and shared by all SID instances using the same
+  // sampling parameters, see set_sampling_parameters().
+  std::shared_ptr<const short> fir_table;
+  const short* fir;
+
+  // SIDBank clocks the voices and filters of its chips itself.
+friend class SIDBank;
 };
 
 
@@ -214,6 +301,8 @@ void SID::clock()
     voice[i].wave.set_waveform_output();
   }
 
+  idle = 0;
+
   // Clock filter.
   filter.clock(voice[0].output(), voice[1].output(), voice[2].output());
 
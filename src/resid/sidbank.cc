@@ -0,0 +1,292 @@
+//  ---------------------------------------------------------------------------
+//  This file is part of reSID, a MOS6581 SID emulator engine.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//  ---------------------------------------------------------------------------
+
+#define RESID_SIDBANK_CC
+
+#include "sidbank.h"
+
+namespace reSID
+{
+
+// ----------------------------------------------------------------------------
+// Constructor.
+// ----------------------------------------------------------------------------
+SIDBank::SIDBank()
+{
+  num_chips = 0;
+  sampling = SAMPLE_RESAMPLE;
+}
+
+
+// ----------------------------------------------------------------------------
+// Set the chips of the bank.
+// ----------------------------------------------------------------------------
+bool SIDBank::set_chips(SID** chips, int n)
+{
+  num_chips = 0;
+  if (n < 1 || n > MAX_CHIPS) {
+    return false;
+  }
+
+  SID* first = chips[0];
+  if (first->sampling == SAMPLE_FAST) {
+    return false;
+  }
+  for (int k = 1; k < n; k++) {
+    SID* sid = chips[k];
+    if (sid->sampling != first->sampling ||
+        sid->cycles_per_sample != first->cycles_per_sample ||
+        sid->fir != first->fir || sid->fir_N != first->fir_N ||
+        sid->fir_RES != first->fir_RES) {
+      return false;
+    }
+  }
+
+  for (int k = 0; k < n; k++) {
+    sids[k] = chips[k];
+  }
+  num_chips = n;
+  sampling = first->sampling;
+  return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// Check that all chips are at the same position within the current sample.
+// ----------------------------------------------------------------------------
+bool SIDBank::in_lockstep()
+{
+  for (int k = 1; k < num_chips; k++) {
+    if (sids[k]->sample_offset != sids[0]->sample_offset) {
+      return false;
+    }
+  }
+  return num_chips > 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// Align the position within the current sample with another chip.
+// ----------------------------------------------------------------------------
+void SIDBank::align(SID* chip, const SID* to)
+{
+  chip->sample_offset = to->sample_offset;
+}
+
+
+// ----------------------------------------------------------------------------
+// SID clocking with audio sampling, see SID::clock_interpolate() and
+// SID::clock_resample(). The position within the sample is shared, so
+// each chip only stores its batch outputs and calculates its samples.
+// ----------------------------------------------------------------------------
+int SIDBank::clock(cycle_count& delta_t, short** buf, int n)
+{
+  const cycle_count cycles_per_sample = sids[0]->cycles_per_sample;
+  cycle_count sample_offset = sids[0]->sample_offset;
+  int s, k;
+
+  for (s = 0; s < n; s++) {
+    cycle_count next_sample_offset = sample_offset + cycles_per_sample;
+    cycle_count delta_t_sample = next_sample_offset >> SID::FIXP_SHIFT;
+
+    if (delta_t_sample > delta_t) {
+      delta_t_sample = delta_t;
+    }
+
+    for (int i = delta_t_sample; i > 0; i -= SID::CLOCK_BATCH) {
+      int batch = i < SID::CLOCK_BATCH ? i : SID::CLOCK_BATCH;
+      clock_batch(batch);
+      for (k = 0; k < num_chips; k++) {
+        switch (sampling) {
+        case SAMPLE_INTERPOLATE:
+          sids[k]->interpolate_batch(out[k], batch, i);
+          break;
+        default:
+        case SAMPLE_RESAMPLE:
+          sids[k]->resample_batch(out[k], batch);
+          break;
+        case SAMPLE_RESAMPLE_FASTMEM:
+          sids[k]->resample_fastmem_batch(out[k], batch);
+          break;
+        }
+      }
+    }
+
+    if ((delta_t -= delta_t_sample) == 0) {
+      sample_offset -= delta_t_sample << SID::FIXP_SHIFT;
+      break;
+    }
+
+    sample_offset = next_sample_offset & SID::FIXP_MASK;
+
+    for (k = 0; k < num_chips; k++) {
+      SID* sid = sids[k];
+      sid->sample_offset = sample_offset;
+      switch (sampling) {
+      case SAMPLE_INTERPOLATE:
+        buf[k][s] = sid->interpolate_output();
+        break;
+      default:
+      case SAMPLE_RESAMPLE:
+        buf[k][s] = sid->resample_output();
+        break;
+      case SAMPLE_RESAMPLE_FASTMEM:
+        buf[k][s] = sid->resample_fastmem_output();
+        break;
+      }
+    }
+  }
+
+  for (k = 0; k < num_chips; k++) {
+    sids[k]->sample_offset = sample_offset;
+  }
+
+  return s;
+}
+
+
+// ----------------------------------------------------------------------------
+// Clock all chips n single cycles, n <= CLOCK_BATCH, see SID::clock_batch().
+// The voices and the filter are clocked chip by chip, the external filters
+// of all chips are then clocked together cycle by cycle.
+// ----------------------------------------------------------------------------
+void SIDBank::clock_batch(int n)
+{
+  int k, c;
+  int first = 0;
+
+  // Pipelined writes on the MOS8580 land after the first cycle. Clock all
+  // chips alike to keep the batches aligned.
+  for (k = 0; k < num_chips; k++) {
+    if (unlikely(sids[k]->write_pipeline)) {
+      for (k = 0; k < num_chips; k++) {
+        sids[k]->clock();
+        out[k][0] = sids[k]->output();
+      }
+      if (--n == 0) {
+        return;
+      }
+      first = 1;
+      break;
+    }
+  }
+
+  short env_out[3][SID::CLOCK_BATCH];
+  short wave_out[3][SID::CLOCK_BATCH];
+
+  // Filter outputs and external filter state of the chips, indexed by cycle
+  // and chip for the external filter loop.
+  short filter_out[SID::CLOCK_BATCH][MAX_CHIPS];
+  int Vlp[MAX_CHIPS], Vhp[MAX_CHIPS];
+  int w0lp_1_s7[MAX_CHIPS], w0hp_1_s17[MAX_CHIPS];
+  int ext_out[SID::CLOCK_BATCH][MAX_CHIPS];
+  bool settle[MAX_CHIPS];
+  SID::FilterState state[MAX_CHIPS];
+
+  for (k = 0; k < num_chips; k++) {
+    SID* sid = sids[k];
+    sid->clock_voices(env_out, wave_out, n);
+
+    settle[k] = false;
+    if (unlikely(sid->idle == -1)) {
+      // The filter would not change, so neither does its output. The
+      // external filter has settled for this input, clocking it again
+      // leaves it unchanged.
+      short value = sid->filter.output();
+      for (c = 0; c < n; c++) {
+        filter_out[c][k] = value;
+      }
+    }
+    else {
+      Filter& filter = sid->filter;
+      for (c = 0; c < n - 1; c++) {
+        filter.clock(wave_out[0][c]*env_out[0][c], wave_out[1][c]*env_out[1][c],
+                     wave_out[2][c]*env_out[2][c]);
+        filter_out[c][k] = filter.output();
+      }
+
+      settle[k] = sid->voices_idle();
+      if (unlikely(settle[k])) {
+        state[k] = sid->filter_state();
+      }
+
+      filter.clock(wave_out[0][c]*env_out[0][c], wave_out[1][c]*env_out[1][c],
+                   wave_out[2][c]*env_out[2][c]);
+      filter_out[c][k] = filter.output();
+    }
+
+    ExternalFilter& extfilt = sid->extfilt;
+    Vlp[k] = extfilt.Vlp;
+    Vhp[k] = extfilt.Vhp;
+    w0lp_1_s7[k] = extfilt.w0lp_1_s7;
+    w0hp_1_s17[k] = extfilt.w0hp_1_s17;
+  }
+
+  // Clock the external filters, see ExternalFilter::clock(short Vi).
+  for (c = 0; c < n; c++) {
+    if (c == n - 1) {
+      for (k = 0; k < num_chips; k++) {
+        state[k].ext_Vlp = Vlp[k];
+        state[k].ext_Vhp = Vhp[k];
+      }
+    }
+    for (k = 0; k < num_chips; k++) {
+      int dVlp = w0lp_1_s7[k]*int((unsigned(filter_out[c][k]) << 11) - unsigned(Vlp[k])) >> 7;
+      int dVhp = w0hp_1_s17[k]*(Vlp[k] - Vhp[k]) >> 17;
+      Vlp[k] += dVlp;
+      Vhp[k] += dVhp;
+      ext_out[c][k] = (Vlp[k] - Vhp[k]) >> 11;
+    }
+  }
+
+  for (k = 0; k < num_chips; k++) {
+    SID* sid = sids[k];
+    ExternalFilter& extfilt = sid->extfilt;
+
+    if (likely(extfilt.enabled)) {
+      extfilt.Vlp = Vlp[k];
+      extfilt.Vhp = Vhp[k];
+      for (c = 0; c < n; c++) {
+        out[k][first + c] = ext_out[c][k];
+      }
+    }
+    else {
+      // Pass through, see ExternalFilter::clock().
+      for (c = 0; c < n; c++) {
+        if (c == n - 1) {
+          state[k].ext_Vlp = extfilt.Vlp;
+          state[k].ext_Vhp = extfilt.Vhp;
+        }
+        extfilt.clock(filter_out[c][k]);
+        out[k][first + c] = extfilt.output();
+      }
+    }
+
+    if (sid->idle != -1) {
+      sid->idle = settle[k] && state[k] == sid->filter_state() ? -1 : 0;
+    }
+
+    // Age bus value.
+    if (unlikely(sid->bus_value_ttl > 0 && sid->bus_value_ttl <= n)) {
+      sid->bus_value = 0;
+    }
+    sid->bus_value_ttl -= n;
+  }
+}
+
+} // namespace reSID
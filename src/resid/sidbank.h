@@ -0,0 +1,77 @@
+//  ---------------------------------------------------------------------------
+//  This file is part of reSID, a MOS6581 SID emulator engine.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//  ---------------------------------------------------------------------------
+
+#ifndef RESID_SIDBANK_H
+#define RESID_SIDBANK_H
+
+#include "sid.h"
+
+namespace reSID
+{
+
+// ----------------------------------------------------------------------------
+// A bank of SID chips clocked in lockstep.
+// The chips share the sampling parameters and the position within the
+// current sample, so the sample scheduling is done once for the bank. Only
+// the external filters of all chips are clocked together, as one
+// struct-of-arrays loop the compiler may vectorize. Envelopes, oscillators
+// and filters are still clocked chip by chip with their batched single
+// cycle paths.
+// The output of each chip is bit identical to clocking its SID on its own
+// with clock(delta_t, buf, n).
+// ----------------------------------------------------------------------------
+class SIDBank
+{
+public:
+  enum { MAX_CHIPS = 16 };
+
+  SIDBank();
+
+  // Set the chips. Fails unless all chips use the same cycle based sampling
+  // method (interpolate or resample) and sampling parameters.
+  bool set_chips(SID** chips, int n);
+  int chips() { return num_chips; }
+  SID* chip(int k) { return sids[k]; }
+
+  // True if all chips are at the same position within the current sample,
+  // e.g. not after one of them was clocked on its own or had its state
+  // written.
+  bool in_lockstep();
+
+  // Move a chip to the position of another within the current sample, e.g.
+  // a chip that was paused and joins the bank again.
+  static void align(SID* chip, const SID* to);
+
+  // Clock all chips like SID::clock(delta_t, buf, n), the samples of chip k
+  // are stored in buf[k]. Requires in_lockstep().
+  int clock(cycle_count& delta_t, short** buf, int n);
+
+protected:
+  void clock_batch(int n);
+
+  SID* sids[MAX_CHIPS];
+  int num_chips;
+  sampling_method sampling;
+
+  // Output of each chip in the current batch.
+  int out[MAX_CHIPS][SID::CLOCK_BATCH];
+};
+
+} // namespace reSID
+
+#endif // not RESID_SIDBANK_H
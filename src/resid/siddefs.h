@@ -27,6 +27,13 @@
 
 #define NEW_8580_FILTER 0
 
+// Compact filter lookup tables: the gain, summer and mixer op-amp tables of
+// the MOS6581 filter only store every (1 << RESID_COMPACT_FILTER)th entry and
+// interpolate linearly in between. 0 builds the full tables.
+#ifndef RESID_COMPACT_FILTER
+#define RESID_COMPACT_FILTER 0
+#endif
+
 // Compiler specifics.
 #define HAVE_BOOL 1
 #define HAVE_BUILTIN_EXPECT 1
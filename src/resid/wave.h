@@ -43,6 +43,9 @@ public:
 
   void clock();
   void clock(cycle_count delta_t);
+  bool can_clock_batch(int n);
+  void clock_batch(short* out, int n, short zero, reg24 source_accumulator,
+                   reg24 source_freq);
   void synchronize();
   void reset();
 
@@ -245,6 +248,73 @@ void WaveformGenerator::clock(cycle_count delta_t)
 }
 
 
+// ----------------------------------------------------------------------------
+// SID clocking - n single cycles of clock() and set_waveform_output()
+// without synchronization, storing the DAC output minus zero of each cycle.
+// The general case is left to the single cycle functions: the test bit,
+// combined waveforms writing to the shift register or (MOS6581) to the
+// accumulator, and a floating DAC input fading within the batch.
+// ----------------------------------------------------------------------------
+RESID_INLINE
+bool WaveformGenerator::can_clock_batch(int n)
+{
+  if (unlikely(test) || unlikely(waveform > 0x8)) {
+    return false;
+  }
+  if (waveform == 0) {
+    return !floating_output_ttl || floating_output_ttl > n;
+  }
+  return sid_model != MOS6581 || !(waveform & 0x2) || !(waveform & 0xd);
+}
+
+// The accumulator of the sync source is only used for ring modulation. It
+// is passed with its value before the batch and its frequency (zero with
+// the test bit set), since the source may have been clocked already.
+RESID_INLINE
+void WaveformGenerator::clock_batch(short* out, int n, short zero,
+                                   reg24 source_accumulator, reg24 source_freq)
+{
+  const unsigned short* dac = model_dac[sid_model];
+  bool tri_saw_delay = (waveform & 3) && (sid_model == MOS8580);
+  reg24 accumulator_bits_set = 0;
+
+  for (int c = 0; c < n; c++) {
+    // clock()
+    reg24 accumulator_next = (accumulator + freq) & 0xffffff;
+    accumulator_bits_set = ~accumulator & accumulator_next;
+    accumulator = accumulator_next;
+    source_accumulator += source_freq;
+
+    if (unlikely(accumulator_bits_set & 0x080000)) {
+      shift_pipeline = 2;
+    }
+    else if (unlikely(shift_pipeline) && !--shift_pipeline) {
+      clock_shift_register();
+    }
+
+    // set_waveform_output()
+    if (likely(waveform)) {
+      int ix = (accumulator ^ (~source_accumulator & ring_msb_mask)) >> 12;
+      waveform_output = wave[ix] & (no_pulse | pulse_output) & no_noise_or_noise_output;
+      if (tri_saw_delay) {
+        osc3 = tri_saw_pipeline & (no_pulse | pulse_output) & no_noise_or_noise_output;
+        tri_saw_pipeline = wave[ix];
+      }
+      else {
+        osc3 = waveform_output;
+      }
+    }
+    pulse_output = -((accumulator >> 12) >= pw) & 0xfff;
+
+    out[c] = dac[waveform_output] - zero;
+  }
+
+  msb_rising = (accumulator_bits_set & 0x800000) ? true : false;
+  if (!waveform && floating_output_ttl) {
+    floating_output_ttl -= n;
+  }
+}
+
 // ----------------------------------------------------------------------------
 // Synchronize oscillators.
 // This must be done after all the oscillators have been clock()'ed since the
@@ -0,0 +1,297 @@
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "sid_dump.h"
+
+SidDumpStream::~SidDumpStream()
+{
+    close();
+}
+
+bool SidDumpStream::open(const std::string &filePath, bool loopDump, std::string &error)
+{
+    close();
+    path = filePath;
+    loop = loopDump;
+
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(fh == INVALID_HANDLE_VALUE) {
+        error = "can't open file";
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(fh, &fileSize)) {
+        CloseHandle(fh);
+        error = "can't get file size";
+        return false;
+    }
+    size = (size_t)fileSize.QuadPart;
+    if(size < FRAME_SIZE) {
+        CloseHandle(fh);
+        error = "no register frames";
+        return false;
+    }
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mh == NULL) {
+        CloseHandle(fh);
+        error = "can't map file";
+        return false;
+    }
+    data = (const uint8_t *)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if(data == nullptr) {
+        CloseHandle(mh);
+        CloseHandle(fh);
+        error = "can't map file";
+        return false;
+    }
+    fileHandle = fh;
+    mapHandle = mh;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        error = "can't open file";
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        ::close(fd);
+        error = "can't get file size";
+        return false;
+    }
+    size = (size_t)st.st_size;
+    if(size < FRAME_SIZE) {
+        ::close(fd);
+        error = "no register frames";
+        return false;
+    }
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid without the descriptor
+    ::close(fd);
+    if(map == MAP_FAILED) {
+        error = "can't map file";
+        return false;
+    }
+    // the dump is read front to back: let the kernel read ahead
+    madvise(map, size, MADV_SEQUENTIAL);
+    data = (const uint8_t *)map;
+#endif
+
+    // a trailing partial frame is ignored
+    numFrames = size / FRAME_SIZE;
+    readFrame = 0;
+    finished.store(false);
+    head.store(0);
+    tail.store(0);
+    return true;
+}
+
+void SidDumpStream::close()
+{
+    if(data == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE)mapHandle);
+    CloseHandle((HANDLE)fileHandle);
+    mapHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap((void *)data, size);
+#endif
+    data = nullptr;
+    size = 0;
+    numFrames = 0;
+}
+
+void SidDumpStream::readAhead()
+{
+    if(data == nullptr || finished.load(std::memory_order_relaxed)) {
+        return;
+    }
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t free = RING_FRAMES - (h - tail.load(std::memory_order_acquire));
+    bool end = false;
+    while(free > 0) {
+        if(readFrame == numFrames) {
+            if(!loop) {
+                end = true;
+                break;
+            }
+            readFrame = 0;
+        }
+        // page faults on the mapping happen here, not on the audio thread
+        memcpy(ring[h % RING_FRAMES], data + readFrame * FRAME_SIZE, FRAME_SIZE);
+        readFrame++;
+        h++;
+        free--;
+    }
+    head.store(h, std::memory_order_release);
+    // set after the last frame is published, see atEnd()
+    if(end) {
+        finished.store(true, std::memory_order_release);
+    }
+}
+
+bool SidDumpStream::pop(uint8_t *regs)
+{
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if(t == head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    memcpy(regs, ring[t % RING_FRAMES], FRAME_SIZE);
+    tail.store(t + 1, std::memory_order_release);
+    // until the player refilled the ring, a missed wakeup is repeated
+    // with the next frame
+    if(player && head.load(std::memory_order_relaxed) - (t + 1) < RING_FRAMES / 2
+        && !finished.load(std::memory_order_relaxed)) {
+        player->wake();
+    }
+    return true;
+}
+
+bool SidDumpStream::atEnd()
+{
+    if(!finished.load(std::memory_order_acquire)) {
+        return data == nullptr;
+    }
+    return tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire);
+}
+
+SidDumpStream::Step SidDumpStream::step(bool clock, uint8_t *regs)
+{
+    // the end is checked before taking a frame, so the last frame is
+    // played for at least one sample
+    if(atEnd()) {
+        return STEP_END;
+    }
+    // an empty ring only repeats the last frame
+    if(clock && pop(regs)) {
+        return STEP_FRAME;
+    }
+    return STEP_NONE;
+}
+
+SidDumpPlayer::SidDumpPlayer()
+: ready(nullptr)
+{
+}
+
+SidDumpPlayer::~SidDumpPlayer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cond.notify_one();
+    if(thread.joinable()) {
+        thread.join();
+    }
+
+    // the ready stream is in streams, too
+    for(SidDumpStream *stream : requested) {
+        delete stream;
+    }
+    for(SidDumpStream *stream : streams) {
+        delete stream;
+    }
+}
+
+void SidDumpPlayer::request(SidDumpStream *stream)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requested.push_back(stream);
+        if(!active) {
+            // the last worker has ended or is about to
+            if(thread.joinable()) {
+                thread.join();
+            }
+            active = true;
+            thread = std::thread(&SidDumpPlayer::run, this);
+        }
+    }
+    cond.notify_one();
+}
+
+SidDumpStream *SidDumpPlayer::fetch()
+{
+    if(ready.load(std::memory_order_relaxed) == nullptr) {
+        return nullptr;
+    }
+    return ready.exchange(nullptr, std::memory_order_acquire);
+}
+
+void SidDumpPlayer::retire(SidDumpStream *stream)
+{
+    if(stream) {
+        stream->retired.store(true, std::memory_order_release);
+        wake();
+    }
+}
+
+void SidDumpPlayer::wake()
+{
+    refill.store(true, std::memory_order_release);
+    cond.notify_one();
+}
+
+void SidDumpPlayer::run()
+{
+    std::vector<SidDumpStream*> added;
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!quit) {
+        cond.wait(lock, [this] {
+            return !requested.empty() || quit || refill.load(std::memory_order_acquire);
+        });
+        if(quit) {
+            break;
+        }
+        refill.store(false, std::memory_order_relaxed);
+        added.swap(requested);
+
+        // read the files without holding the lock
+        lock.unlock();
+
+        for(size_t i=0;i<streams.size();) {
+            SidDumpStream *stream = streams[i];
+            if(stream->retired.load(std::memory_order_acquire)) {
+                delete stream;
+                streams.erase(streams.begin() + i);
+            } else {
+                stream->readAhead();
+                i++;
+            }
+        }
+
+        // hand out new streams with a filled ring
+        for(SidDumpStream *stream : added) {
+            stream->readAhead();
+            stream->player = this;
+            streams.push_back(stream);
+            // a stream the audio thread has not picked up yet is replaced
+            SidDumpStream *old = ready.exchange(stream, std::memory_order_acq_rel);
+            if(old) {
+                old->retired.store(true, std::memory_order_release);
+            }
+        }
+        added.clear();
+
+        lock.lock();
+        // all streams deleted: end until the next request
+        if(streams.empty() && requested.empty()) {
+            active = false;
+            break;
+        }
+    }
+}
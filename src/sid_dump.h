@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SidDumpPlayer;
+
+// A SID register dump file: the 25 write registers $D400-$D418 stored as
+// raw bytes for each frame, one frame per register update (vsync).
+//
+// The file is memory mapped and the SidDumpPlayer thread copies the frames
+// ahead of the play position into a ring, so the audio thread never touches
+// the file or the mapping and multi-hour dumps are never loaded as a whole.
+struct SidDumpStream {
+    static constexpr int FRAME_SIZE = 25;
+    // frames buffered ahead of the play position (82s at 50Hz)
+    static constexpr uint32_t RING_FRAMES = 4096;
+
+    SidDumpStream() {}
+    SidDumpStream(const SidDumpStream&) = delete;
+    SidDumpStream &operator=(const SidDumpStream&) = delete;
+    ~SidDumpStream();
+
+    // map the file (not on the audio thread)
+    bool open(const std::string &path, bool loop, std::string &error);
+    void close();
+
+    bool isOpen() { return data != nullptr; }
+    uint64_t getNumFrames() { return numFrames; }
+    const std::string &getPath() { return path; }
+
+    // player thread: copy frames into the free part of the ring
+    void readAhead();
+
+    // audio thread: take the registers of the next frame,
+    // false at the end of the dump or if the ring ran empty
+    bool pop(uint8_t *regs);
+    // audio thread: no more frames will follow
+    bool atEnd();
+
+    enum Step {
+        STEP_NONE,
+        STEP_FRAME,
+        STEP_END
+    };
+    // audio thread: play the dump for one sample, on a frame clock take the
+    // registers of the next frame (STEP_FRAME). STEP_END follows on the
+    // sample after the last frame, so the last frame is always played.
+    Step step(bool clock, uint8_t *regs);
+
+protected:
+    std::string path;
+    bool loop = false;
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    uint64_t numFrames = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mapHandle = nullptr;
+#endif
+
+    // next frame copied into the ring (player thread only)
+    uint64_t readFrame = 0;
+    std::atomic<bool> finished{false};
+    // handed back by the audio thread, deleted by the player thread
+    std::atomic<bool> retired{false};
+    // woken to refill the ring, set before the stream is handed out
+    SidDumpPlayer *player = nullptr;
+
+    // single producer (player thread), single consumer (audio thread)
+    uint8_t ring[RING_FRAMES][FRAME_SIZE];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+
+    friend struct SidDumpPlayer;
+};
+
+// Hands dump streams to the audio thread and keeps their rings filled on a
+// worker thread, which sleeps until a ring is half empty. The worker is
+// started by request() and ends once all streams are deleted, so a module
+// that plays no dump has no thread. Like
+// SidEngineBuilder the audio thread swaps in a new stream with fetch() and
+// hands back the replaced one with retire(). The worker owns all streams and
+// deletes retired ones, so nothing is freed on the audio thread.
+struct SidDumpPlayer {
+    SidDumpPlayer();
+    ~SidDumpPlayer();
+
+    // start playing an opened stream, or stop with a stream that is not open;
+    // the player takes ownership
+    void request(SidDumpStream *stream);
+    // audio thread: take a new stream or nullptr (non-blocking)
+    SidDumpStream *fetch();
+    // audio thread: hand back a replaced stream for deletion
+    void retire(SidDumpStream *stream);
+
+protected:
+    friend struct SidDumpStream;
+
+    void run();
+    // audio thread: refill the rings and delete retired streams (lock-free)
+    void wake();
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    // the worker runs and has not decided to end
+    bool active = false;
+    bool quit = false;
+    std::vector<SidDumpStream*> requested;
+    std::atomic<bool> refill{false};
+
+    // streams handed out, only accessed by the worker thread
+    std::vector<SidDumpStream*> streams;
+
+    std::atomic<SidDumpStream*> ready;
+};
@@ -0,0 +1,530 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "sid_engine.h"
+
+SidEngine::~SidEngine()
+{
+    delete pool;
+    delete[] banks;
+    delete[] channels;
+    SidEngineState *lists[] = { spareStates, droppedStates };
+    for(SidEngineState *state : lists) {
+        while(state) {
+            SidEngineState *next = state->next;
+            delete state;
+            state = next;
+        }
+    }
+}
+
+void SidEngine::setupChip(reSID::SID &sid, reSID::chip_model model)
+{
+    // select the model first, its filter tables are built on first use
+    sid.set_chip_model(model);
+    sid.reset();
+
+    // configure SID
+    // enable 3 voices and aux
+    sid.set_voice_mask(0xf);
+    sid.enable_filter(true);
+    sid.adjust_filter_bias(model == reSID::MOS6581 ? 0.5 : 0.0);
+    sid.enable_external_filter(true);
+}
+
+void SidEngine::configure(const Config &cfg)
+{
+    config = cfg;
+
+#ifdef DEBUG_SID
+    printf("SID configure: chipModel=%d cpuClockHz=%f sampleRate=%f numChannels=%d\n",
+        cfg.chipModel, cfg.cpuClockHz, cfg.sampleRate, cfg.numChannels);
+#endif
+
+    // CPU clock steps between audio samples
+    cpuClockSteps = (reSID::cycle_count)roundf(cfg.cpuClockHz / cfg.sampleRate);
+    // by performing these clock steps what is the real clock hz used
+    cpuClockRealHz = cpuClockSteps * cfg.sampleRate;
+    pitchTable.setClock(cpuClockRealHz);
+#ifdef DEBUG_SID
+    printf("cpuClockSteps: %d, cpuClockRealHz=%f\n", cpuClockSteps, cpuClockRealHz);
+#endif
+
+    bool is6581 = (cfg.chipModel == reSID::MOS6581);
+    // reSID only delays MOS8580 writes by one cycle with SAMPLE_FAST
+    int writeDelay = (!is6581 && cfg.samplingMethod != reSID::SAMPLE_FAST) ? 1 : 0;
+
+    delete[] channels;
+    numChannels = std::max(1, std::min(cfg.numChannels, (int)MAX_CHANNELS));
+    channels = new SidChannel[numChannels];
+
+    for(int c=0;c<numChannels;c++) {
+        SidChannel &ch = channels[c];
+        reSID::SID &sid = ch.sid;
+
+        setupChip(sid, cfg.chipModel);
+
+        // all channels share one FIR table
+        sid.set_sampling_parameters(cpuClockRealHz, cfg.samplingMethod, cfg.sampleRate);
+        ch.renderer.configure(cfg.blockSize, cpuClockSteps, cfg.direct, cfg.writeCycles, writeDelay);
+
+        for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
+            ch.voiceRegs[i].reset();
+        }
+        ch.filterRegs.reset();
+    }
+    numRenderIds = 0;
+
+    // worker threads are started here on the builder thread
+    delete pool;
+    pool = nullptr;
+    int numThreads = std::min(cfg.numThreads, numChannels);
+    if(numThreads > 1) {
+        pool = new WorkerPool(numThreads);
+    }
+
+    setupBanks();
+
+    // the snapshot states, sized here so the audio thread does not allocate
+    static std::atomic<uint64_t> lastId{0};
+    id = ++lastId;
+    while(spareStates) {
+        SidEngineState *next = spareStates->next;
+        delete spareStates;
+        spareStates = next;
+    }
+    for(int i=0;i<NUM_STATES;i++) {
+        SidEngineState *state = new SidEngineState();
+        state->engineId = id;
+        state->channels.resize(numChannels);
+        for(int c=0;c<numChannels;c++) {
+            channels[c].sid.reserve_state(state->channels[c].sid);
+        }
+        state->next = spareStates;
+        spareStates = state;
+    }
+}
+
+void SidEngine::setupBanks()
+{
+    delete[] banks;
+    banks = nullptr;
+    maxBanks = 0;
+    numBanks = 0;
+    bankChannels = 0;
+    if(config.direct || numChannels < 2) {
+        return;
+    }
+    // at least two channels per bank but the last
+    maxBanks = (numChannels + 1) / 2;
+    banks = new reSID::SIDBank[maxBanks];
+    formBanks(numChannels);
+}
+
+void SidEngine::formBanks(int n)
+{
+    numBanks = 0;
+    bankChannels = n;
+    // split the channels evenly over the render threads
+    int numThreads = pool != nullptr ? pool->getNumThreads() : 1;
+    int perBank = (n + numThreads - 1) / numThreads;
+    if(perBank < 2) {
+        return;
+    }
+    int num = (n + perBank - 1) / perBank;
+    reSID::SID *chips[MAX_CHANNELS];
+    for(int b=0;b<num;b++) {
+        int first = b * perBank;
+        int k = std::min(perBank, n - first);
+        for(int i=0;i<k;i++) {
+            chips[i] = &channels[first + i].sid;
+        }
+        if(!banks[b].set_chips(chips, k)) {
+            return;
+        }
+    }
+    numBanks = num;
+}
+
+bool SidEngine::canRenderBanks()
+{
+    if(maxBanks == 0 || numRenderIds == 0) {
+        return false;
+    }
+    // renderIds are ascending: the first numRenderIds channels
+    if(renderIds[numRenderIds - 1] != numRenderIds - 1) {
+        return false;
+    }
+    // played channels changed
+    if(numRenderIds != bankChannels) {
+        formBanks(numRenderIds);
+    }
+    if(numBanks == 0) {
+        return false;
+    }
+    for(int b=0;b<numBanks;b++) {
+        if(!banks[b].in_lockstep()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SidEngine::render()
+{
+    if(canRenderBanks()) {
+        if(pool != nullptr && numBanks > 1) {
+            pool->run(renderBankJob, this, numBanks);
+        } else {
+            for(int b=0;b<numBanks;b++) {
+                renderBankJob(this, b);
+            }
+        }
+    } else if(pool != nullptr && numRenderIds > 1) {
+        pool->run(renderJob, this, numRenderIds);
+    } else {
+        for(int i=0;i<numRenderIds;i++) {
+            renderJob(this, i);
+        }
+    }
+    numRenderIds = 0;
+}
+
+void SidEngine::resume(int c)
+{
+    channels[c].renderer.resume(channels[0].renderer.pos);
+    reSID::SIDBank::align(&channels[c].sid, &channels[0].sid);
+}
+
+void SidEngine::renderJob(void *context, int job)
+{
+    SidEngine *engine = (SidEngine *)context;
+    SidChannel &ch = engine->channels[engine->renderIds[job]];
+    ch.renderer.render(ch.sid);
+}
+
+void SidEngine::renderBankJob(void *context, int job)
+{
+    SidEngine *engine = (SidEngine *)context;
+    reSID::SIDBank &bank = engine->banks[job];
+    // banks hold consecutive channels of the same size except the last
+    int first = job * engine->banks[0].chips();
+    SidRenderer *renderers[reSID::SIDBank::MAX_CHIPS];
+    for(int k=0;k<bank.chips();k++) {
+        renderers[k] = &engine->channels[first + k].renderer;
+    }
+    SidRenderer::renderBank(renderers, bank);
+}
+
+void SidEngine::saveState(SidEngineState &state)
+{
+    state.chipModel = config.chipModel;
+    state.serial = stateSerial;
+    state.blockSize = channels[0].renderer.blockSize;
+    state.numChannels = numChannels;
+    for(int c=0;c<numChannels;c++) {
+        SidChannel &ch = channels[c];
+        SidEngineState::Channel &sc = state.channels[c];
+        ch.sid.read_state(sc.sid);
+        std::copy(ch.renderer.audio, ch.renderer.audio + state.blockSize, sc.audio);
+        std::copy(ch.renderer.voice3Osc, ch.renderer.voice3Osc + state.blockSize, sc.voice3Osc);
+        std::copy(ch.renderer.voice3Env, ch.renderer.voice3Env + state.blockSize, sc.voice3Env);
+    }
+}
+
+bool SidEngine::ownsState(const SidEngineState *state) const
+{
+    return state != nullptr && state->engineId == id;
+}
+
+SidEngineState *SidEngine::takeState()
+{
+    SidEngineState *state = spareStates;
+    if(state) {
+        spareStates = state->next;
+        state->next = nullptr;
+    }
+    return state;
+}
+
+void SidEngine::dropState(SidEngineState *state)
+{
+    if(state) {
+        state->next = droppedStates;
+        droppedStates = state;
+    }
+}
+
+void SidEngine::restoreState(const SidEngineState &state)
+{
+    if(state.chipModel != config.chipModel) {
+        return;
+    }
+    int num = std::min(state.numChannels, numChannels);
+    for(int c=0;c<num;c++) {
+        SidChannel &ch = channels[c];
+        const SidEngineState::Channel &sc = state.channels[c];
+        ch.sid.write_state(sc.sid);
+        if(state.blockSize == ch.renderer.blockSize) {
+            std::copy(sc.audio, sc.audio + state.blockSize, ch.renderer.audio);
+            std::copy(sc.voice3Osc, sc.voice3Osc + state.blockSize, ch.renderer.voice3Osc);
+            std::copy(sc.voice3Env, sc.voice3Env + state.blockSize, ch.renderer.voice3Env);
+            // zero latency: the block is the current output
+            ch.renderer.sample = sc.audio[0];
+            ch.renderer.osc = sc.voice3Osc[0];
+            ch.renderer.env = sc.voice3Env[0];
+        }
+    }
+}
+
+constexpr uint8_t SidEngineState::STATE_VERSION;
+
+// The binary state: version, chip model (0: 6581, 1: 8580), block size
+// (u16 LE) and number of channels, then for each channel the size of the
+// serialized SID::State (u32 LE), the state and the rendered block as
+// audio (s16 LE), voice 3 oscillator and envelope.
+std::vector<uint8_t> SidEngineState::serialize() const
+{
+    std::vector<uint8_t> data;
+    data.push_back(STATE_VERSION);
+    data.push_back(chipModel == reSID::MOS8580 ? 1 : 0);
+    data.push_back(blockSize & 0xff);
+    data.push_back(blockSize >> 8);
+    data.push_back(numChannels);
+    for(int c=0;c<numChannels;c++) {
+        const Channel &ch = channels[c];
+        std::vector<unsigned char> sid = ch.sid.serialize();
+        uint32_t size = sid.size();
+        for(int i=0;i<4;i++) {
+            data.push_back((size >> (i * 8)) & 0xff);
+        }
+        data.insert(data.end(), sid.begin(), sid.end());
+        for(int i=0;i<blockSize;i++) {
+            data.push_back(ch.audio[i] & 0xff);
+            data.push_back((ch.audio[i] >> 8) & 0xff);
+            data.push_back(ch.voice3Osc[i]);
+            data.push_back(ch.voice3Env[i]);
+        }
+    }
+    return data;
+}
+
+bool SidEngineState::deserialize(const uint8_t *data, size_t size)
+{
+    numChannels = 0;
+    if(size < 5 || data[0] != STATE_VERSION) {
+        return false;
+    }
+    int model = data[1];
+    int block = data[2] | data[3] << 8;
+    int num = data[4];
+    if(model > 1 || block < 1 || block > SidRenderer::MAX_BLOCK_SIZE
+        || num > SidEngine::MAX_CHANNELS) {
+        return false;
+    }
+    size_t pos = 5;
+    channels.resize(num);
+    for(int c=0;c<num;c++) {
+        Channel &ch = channels[c];
+        if(size - pos < 4) {
+            return false;
+        }
+        uint32_t len = data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16 | (uint32_t)data[pos + 3] << 24;
+        pos += 4;
+        if(size - pos < len || !ch.sid.deserialize(data + pos, len)) {
+            return false;
+        }
+        pos += len;
+        if(size - pos < (size_t)block * 4) {
+            return false;
+        }
+        for(int i=0;i<block;i++) {
+            ch.audio[i] = (int16_t)(data[pos] | data[pos + 1] << 8);
+            ch.voice3Osc[i] = data[pos + 2];
+            ch.voice3Env[i] = data[pos + 3];
+            pos += 4;
+        }
+    }
+    if(pos != size) {
+        return false;
+    }
+    chipModel = model ? reSID::MOS8580 : reSID::MOS6581;
+    blockSize = block;
+    numChannels = num;
+    return true;
+}
+
+// The thread shared by all builders. It runs while builders exist and
+// sleeps until a builder requests an engine or an engine is retired.
+struct SidEngineBuildThread {
+    std::mutex mutex;
+    std::condition_variable cond;
+    // signals the end of a build to a builder being destroyed
+    std::condition_variable buildDone;
+    std::thread thread;
+    bool running = false;
+    int numBuilders = 0;
+    // builders with a pending request, in request order
+    std::vector<SidEngineBuilder*> queue;
+    SidEngineBuilder *building = nullptr;
+    // lock-free stack of retired engines, pushed by the audio threads
+    std::atomic<SidEngine*> retired{nullptr};
+
+    static SidEngineBuildThread &get()
+    {
+        static SidEngineBuildThread instance;
+        return instance;
+    }
+
+    void add()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(numBuilders++ == 0) {
+            if(thread.joinable()) {
+                thread.join();
+            }
+            running = true;
+            thread = std::thread(&SidEngineBuildThread::run, this);
+        }
+    }
+
+    void remove(SidEngineBuilder *builder)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        queue.erase(std::remove(queue.begin(), queue.end(), builder), queue.end());
+        buildDone.wait(lock, [&] { return building != builder; });
+        if(--numBuilders == 0) {
+            running = false;
+            lock.unlock();
+            cond.notify_one();
+            // the last builder may go away with the module library, so
+            // don't leave the thread running
+            thread.join();
+        }
+    }
+
+    void enqueue(SidEngineBuilder *builder)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(std::find(queue.begin(), queue.end(), builder) == queue.end()) {
+                queue.push_back(builder);
+            }
+        }
+        cond.notify_one();
+    }
+
+    void retire(SidEngine *engine)
+    {
+        SidEngine *head = retired.load(std::memory_order_relaxed);
+        do {
+            engine->nextRetired = head;
+        } while(!retired.compare_exchange_weak(head, engine, std::memory_order_release,
+            std::memory_order_relaxed));
+        // the thread checks the stack under the mutex before it sleeps, so
+        // take it briefly to not lose the wakeup. The audio thread only
+        // gets here when it swaps engines, and nothing holds the mutex for
+        // long: a build runs without it.
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        cond.notify_one();
+    }
+
+    void freeRetired()
+    {
+        SidEngine *engine = retired.exchange(nullptr, std::memory_order_acquire);
+        while(engine) {
+            SidEngine *next = engine->nextRetired;
+            delete engine;
+            engine = next;
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(running) {
+            cond.wait(lock, [this] {
+                return !queue.empty() || !running
+                    || retired.load(std::memory_order_relaxed) != nullptr;
+            });
+
+            lock.unlock();
+            freeRetired();
+            lock.lock();
+
+            if(queue.empty() || !running) {
+                continue;
+            }
+            SidEngineBuilder *builder = queue.front();
+            queue.erase(queue.begin());
+            SidEngine::Config cfg = builder->pendingConfig;
+            SidEngineState *state = builder->pendingState;
+            uint32_t serial = builder->stateSerial;
+            builder->pending = false;
+            builder->pendingState = nullptr;
+            building = builder;
+
+            // build without holding the lock so new requests do not block
+            lock.unlock();
+            SidEngine *engine = new SidEngine();
+            engine->configure(cfg);
+            engine->stateSerial = serial;
+            if(state) {
+                engine->restoreState(*state);
+                delete state;
+            }
+            // replace a built engine the audio thread has not picked up yet
+            delete builder->ready.exchange(engine, std::memory_order_acq_rel);
+            lock.lock();
+            building = nullptr;
+            buildDone.notify_all();
+        }
+        lock.unlock();
+        freeRetired();
+    }
+};
+
+SidEngineBuilder::SidEngineBuilder()
+: ready(nullptr)
+{
+    SidEngineBuildThread::get().add();
+}
+
+SidEngineBuilder::~SidEngineBuilder()
+{
+    SidEngineBuildThread::get().remove(this);
+    delete ready.exchange(nullptr);
+    delete pendingState;
+}
+
+void SidEngineBuilder::request(const SidEngine::Config &cfg, SidEngineState *state)
+{
+    SidEngineBuildThread &buildThread = SidEngineBuildThread::get();
+    {
+        std::lock_guard<std::mutex> lock(buildThread.mutex);
+        pendingConfig = cfg;
+        pending = true;
+        if(state) {
+            delete pendingState;
+            pendingState = state;
+            stateSerial = state->serial;
+        }
+    }
+    buildThread.enqueue(this);
+}
+
+SidEngine *SidEngineBuilder::fetch()
+{
+    if(ready.load(std::memory_order_relaxed) == nullptr) {
+        return nullptr;
+    }
+    return ready.exchange(nullptr, std::memory_order_acquire);
+}
+
+void SidEngineBuilder::retire(SidEngine *engine)
+{
+    SidEngineBuildThread::get().retire(engine);
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sid.h"
+#include "sidbank.h"
+#include "sid_renderer.h"
+#include "voice_regs.h"
+#include "filter_regs.h"
+#include "pitch_table.h"
+#include "worker_pool.h"
+
+struct SidEngineState;
+
+// One emulated chip with the renderer and register shadows feeding it.
+struct SidChannel {
+    reSID::SID sid;
+    SidRenderer renderer;
+    VoiceRegs voiceRegs[VoiceRegs::NUM_VOICES];
+    FilterRegs filterRegs;
+    // last pitch of each voice in semitones, the FREQ register is only
+    // mapped again when it changes (NaN: not mapped yet)
+    float pitch[VoiceRegs::NUM_VOICES] = { NAN, NAN, NAN };
+    // the registers hold the mapped controls, so only the changed ones
+    // need to be mapped again (false: map all on the next update)
+    bool controlsMapped = false;
+};
+
+// The emulation state of one SID configuration: a contiguous array of
+// chips, one per polyphonic channel. Configuring an engine may compute
+// large resampling tables and is therefore done by SidEngineBuilder off
+// the audio thread.
+struct SidEngine {
+    static constexpr int MAX_CHANNELS = 16;
+
+    struct Config {
+        reSID::chip_model chipModel = reSID::MOS8580;
+        reSID::sampling_method samplingMethod = reSID::SAMPLE_RESAMPLE;
+        // clock with delta cycles and pick the output (SAMPLE_DIRECT)
+        bool direct = true;
+        float cpuClockHz = 985248.0f;
+        float sampleRate = 0.0f;
+        int blockSize = 1;
+        // cycles between the register writes of one sample
+        int writeCycles = SidRenderer::WRITE_CYCLES;
+        int numChannels = 1;
+        // threads rendering the channels, including the audio thread
+        int numThreads = 1;
+    };
+
+    Config config;
+    SidChannel *channels = nullptr;
+    int numChannels = 0;
+
+    // CPU clock steps between audio samples
+    reSID::cycle_count cpuClockSteps = 0;
+    // by performing these clock steps what is the real clock hz used
+    float cpuClockRealHz = 0.0f;
+    // pitch to FREQ register mapping for this clock
+    PitchTable pitchTable;
+
+    // renders the channel blocks in parallel (nullptr: single threaded)
+    WorkerPool *pool = nullptr;
+    // channels collected for render()
+    int renderIds[MAX_CHANNELS];
+    int numRenderIds = 0;
+    // the chips of consecutive channels clocked in lockstep, one bank per
+    // render job (cycle based sampling with several channels, else none),
+    // formed over the first bankChannels channels that are rendered
+    reSID::SIDBank *banks = nullptr;
+    int maxBanks = 0;
+    int numBanks = 0;
+    int bankChannels = 0;
+    // link in the retire queue of SidEngineBuilder
+    SidEngine *nextRetired = nullptr;
+
+    // states sized for this engine by configure(), taken by takeState()
+    static constexpr int NUM_STATES = 3;
+    // unique per configured engine, marks the states sized for it
+    uint64_t id = 0;
+    SidEngineState *spareStates = nullptr;
+    // states of other engines handed over with dropState()
+    SidEngineState *droppedStates = nullptr;
+    // SidEngineState::serial of the last state handed to the builder
+    // before this engine was built
+    uint32_t stateSerial = 0;
+
+    SidEngine() {}
+    SidEngine(const SidEngine&) = delete;
+    SidEngine &operator=(const SidEngine&) = delete;
+    ~SidEngine();
+
+    void configure(const Config &cfg);
+    // model and filter settings of a Sidofon chip, without sampling parameters
+    static void setupChip(reSID::SID &sid, reSID::chip_model model);
+
+    // audio thread: render the blocks of all channels collected in renderIds
+    void render();
+    // audio thread: channel c joins the running block of channel 0 after it
+    // was not played, its chip also at the position of channel 0 within the
+    // sample, so it can be clocked in a bank with it
+    void resume(int c);
+
+    // audio thread at a block boundary: snapshot of all chips into a state
+    // sized for this engine (ownsState()), does not allocate
+    void saveState(SidEngineState &state);
+    // the state was sized for this engine by configure()
+    bool ownsState(const SidEngineState *state) const;
+    // audio thread: one of the NUM_STATES states sized for this engine or
+    // nullptr once all are taken
+    SidEngineState *takeState();
+    // audio thread: hand over a state of another engine (or nullptr), it
+    // is freed with this engine
+    void dropState(SidEngineState *state);
+    // continue a saved engine (not on the audio thread), channels of another
+    // chip model are not restored and render blocks only with the same size
+    void restoreState(const SidEngineState &state);
+
+protected:
+    void setupBanks();
+    // audio thread: the banks over the first n channels, without allocating
+    void formBanks(int n);
+    // the rendered channels are covered by the banks and in lockstep
+    bool canRenderBanks();
+
+    static void renderJob(void *context, int job);
+    static void renderBankJob(void *context, int job);
+};
+
+// A snapshot of all chips of an engine and their rendered output blocks, so
+// a restored engine continues seamlessly: held notes keep sounding and the
+// filters keep their state. The audio thread takes it at a block boundary,
+// the versioned binary form is written and read on other threads.
+struct SidEngineState {
+    static constexpr uint8_t STATE_VERSION = 1;
+
+    struct Channel {
+        reSID::SID::State sid;
+        // block rendered ahead (block latency)
+        int16_t audio[SidRenderer::MAX_BLOCK_SIZE];
+        uint8_t voice3Osc[SidRenderer::MAX_BLOCK_SIZE];
+        uint8_t voice3Env[SidRenderer::MAX_BLOCK_SIZE];
+    };
+
+    reSID::chip_model chipModel = reSID::MOS8580;
+    int blockSize = 0;
+    // 0: no engine was running
+    int numChannels = 0;
+    // at least numChannels
+    std::vector<Channel> channels;
+
+    // not serialized: the engine the state was sized for (SidEngine::id),
+    // the number of the loaded state (saved with the engine built after it)
+    // and the link in the state lists of SidEngine
+    uint64_t engineId = 0;
+    uint32_t serial = 0;
+    SidEngineState *next = nullptr;
+
+    std::vector<uint8_t> serialize() const;
+    bool deserialize(const uint8_t *data, size_t size);
+};
+
+// Builds SidEngines off the audio thread. One build thread serves all
+// builders (module instances): it builds the requested engines and frees the
+// replaced ones, so the audio thread never allocates or frees an engine. The
+// audio thread keeps playing its current engine and swaps in the new one
+// with fetch() once it is ready.
+struct SidEngineBuilder {
+    SidEngineBuilder();
+    ~SidEngineBuilder();
+
+    // request a new engine, a newer request replaces a pending one.
+    // The builder takes the state to restore, it is kept for a newer
+    // request without one.
+    void request(const SidEngine::Config &cfg, SidEngineState *state = nullptr);
+    // audio thread: take a finished engine or nullptr (non-blocking)
+    SidEngine *fetch();
+    // audio thread: hand back a replaced engine, it is freed by the build
+    // thread (pushed lock-free, the wakeup takes the mutex briefly)
+    void retire(SidEngine *engine);
+
+protected:
+    friend struct SidEngineBuildThread;
+
+    // guarded by the mutex of the build thread
+    bool pending = false;
+    SidEngine::Config pendingConfig;
+    SidEngineState *pendingState = nullptr;
+    uint32_t stateSerial = 0;
+
+    std::atomic<SidEngine*> ready;
+};
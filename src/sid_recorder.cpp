@@ -0,0 +1,213 @@
+#include "sid_recorder.h"
+
+SidRecorder::~SidRecorder()
+{
+    join();
+
+    // the audio thread is gone: end an open log here
+    if(ring) {
+        drain();
+        delete[] ring;
+        ring = nullptr;
+    }
+    if(logging) {
+        putVarint(0);
+        fputc(CODE_END, file);
+    }
+    if(file) {
+        fclose(file);
+        file = nullptr;
+        if(state.load() == STATE_STARTED) {
+            remove(path.c_str());
+        }
+    }
+}
+
+void SidRecorder::join()
+{
+    if(!thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cond.notify_one();
+    thread.join();
+    running = true;
+}
+
+bool SidRecorder::start(const std::string &filePath, std::string &error)
+{
+    if(state.load(std::memory_order_acquire) != STATE_IDLE) {
+        // the audio thread may have stopped right after it ended the log
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        cond.notify_one();
+        error = "previous recording is still being written";
+        return false;
+    }
+    FILE *fh = fopen(filePath.c_str(), "wb");
+    if(fh == nullptr) {
+        error = "can't create file";
+        return false;
+    }
+    // the worker of the last recording has freed the ring and is ending
+    join();
+    ring = new Event[RING_SIZE];
+    // the worker takes the file with the begin event of the audio thread
+    file = fh;
+    path = filePath;
+    dropped.store(0, std::memory_order_relaxed);
+    thread = std::thread(&SidRecorder::run, this);
+    state.store(STATE_STARTED, std::memory_order_release);
+    return true;
+}
+
+void SidRecorder::stop()
+{
+    int s = STATE_STARTED;
+    if(state.compare_exchange_strong(s, STATE_IDLE, std::memory_order_acq_rel)) {
+        // not begun by the audio thread, the file and the ring are still
+        // ours
+        join();
+        delete[] ring;
+        ring = nullptr;
+        fclose(file);
+        file = nullptr;
+        remove(path.c_str());
+        return;
+    }
+    s = STATE_RECORDING;
+    state.compare_exchange_strong(s, STATE_STOPPED, std::memory_order_acq_rel);
+}
+
+bool SidRecorder::update(reSID::chip_model chipModel, float clockHz)
+{
+    bool begin = false;
+    int s = state.load(std::memory_order_acquire);
+    // begin only with room for the begin event, else on a later sample
+    if(s == STATE_STARTED
+        && head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire) < RING_SIZE - 1
+        && state.compare_exchange_strong(s, STATE_RECORDING, std::memory_order_acq_rel)) {
+        capturing = true;
+        time = 0;
+        model = chipModel == reSID::MOS8580 ? 1 : 0;
+        clock = (uint32_t)(clockHz + 0.5f);
+        push(0, CODE_BEGIN, 0);
+        begin = true;
+    } else if(s == STATE_STOPPED) {
+        // the ring always has room for the end event
+        push(time, CODE_END, 0);
+        capturing = false;
+        state.store(STATE_ENDED, std::memory_order_release);
+        s = STATE_ENDED;
+    }
+
+    // wake the worker to write a part of the ring or to close the log,
+    // until it did so (a wakeup is lost if it was just going to sleep)
+    if(s == STATE_ENDED || head.load(std::memory_order_relaxed)
+        - tail.load(std::memory_order_relaxed) >= RING_SIZE / 4) {
+        cond.notify_one();
+    }
+    return begin;
+}
+
+void SidRecorder::write(uint32_t cycle, uint8_t offset, uint8_t value)
+{
+    push(time + cycle, offset, value);
+}
+
+void SidRecorder::input(uint32_t cycle, int16_t value)
+{
+    push(time + cycle, CODE_INPUT, value);
+}
+
+void SidRecorder::push(uint64_t cycle, uint8_t code, int16_t value)
+{
+    uint32_t h = head.load(std::memory_order_relaxed);
+    // keep a slot for the end event, so a log is always terminated
+    uint32_t limit = code == CODE_END ? RING_SIZE : RING_SIZE - 1;
+    if(h - tail.load(std::memory_order_acquire) >= limit) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Event &ev = ring[h % RING_SIZE];
+    ev.cycle = cycle;
+    ev.code = code;
+    ev.value = value;
+    head.store(h + 1, std::memory_order_release);
+}
+
+void SidRecorder::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(running) {
+        cond.wait(lock);
+        if(!running) {
+            break;
+        }
+        lock.unlock();
+        if(drain()) {
+            // the audio thread is done with the ring until the next start()
+            delete[] ring;
+            ring = nullptr;
+            state.store(STATE_IDLE, std::memory_order_release);
+            return;
+        }
+        lock.lock();
+    }
+}
+
+bool SidRecorder::drain()
+{
+    bool ended = false;
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    while(t != h) {
+        const Event &ev = ring[t % RING_SIZE];
+        if(ev.code == CODE_BEGIN) {
+            static const char magic[4] = { 'S', 'I', 'D', 'W' };
+            fwrite(magic, 1, 4, file);
+            fputc(LOG_VERSION, file);
+            fputc(model, file);
+            for(int i=0;i<4;i++) {
+                fputc((clock >> (i * 8)) & 0xff, file);
+            }
+            lastCycle = 0;
+            logging = true;
+        } else if(logging) {
+            putVarint(ev.cycle - lastCycle);
+            lastCycle = ev.cycle;
+            fputc(ev.code, file);
+            if(ev.code == CODE_INPUT) {
+                fputc(ev.value & 0xff, file);
+                fputc((ev.value >> 8) & 0xff, file);
+            } else if(ev.code == CODE_END) {
+                fclose(file);
+                file = nullptr;
+                logging = false;
+                ended = true;
+            } else {
+                fputc(ev.value & 0xff, file);
+            }
+        }
+        t++;
+        // hand back the slots early while a long backlog is written
+        if((t & 1023) == 0) {
+            tail.store(t, std::memory_order_release);
+        }
+    }
+    tail.store(t, std::memory_order_release);
+    return ended;
+}
+
+void SidRecorder::putVarint(uint64_t value)
+{
+    while(value >= 0x80) {
+        fputc((int)(value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "sid.h"
+
+// Records the register writes and aux input changes of a SidRenderer with
+// their SID cycle into a compact log file, so a performance can be rendered
+// again offline with any sampling method.
+//
+// The audio thread only appends to a lock-free ring, a worker thread drains
+// it and writes the file. Ring and worker only exist from start() until the
+// log is written, an idle recorder holds neither. The log starts with a
+// header
+//
+//   "SIDW", version, chip model (0: 6581, 1: 8580), SID clock Hz (u32 LE)
+//
+// followed by one record per event: the cycles since the previous event as
+// unsigned LEB128 varint and a code byte, then the value:
+//
+//   $00-$18  register write, 1 byte value
+//   $fe      aux input, 2 bytes signed LE
+//   $ff      end of the log (no value)
+//
+// Writes of one frame are a few cycles apart, so most records take 3 bytes.
+struct SidRecorder {
+    static constexpr uint8_t LOG_VERSION = 1;
+    static constexpr uint8_t CODE_INPUT = 0xfe;
+    static constexpr uint8_t CODE_END = 0xff;
+    // events buffered for the worker, about 60ms of writes to all registers
+    // in every sample at 44.1kHz
+    static constexpr uint32_t RING_SIZE = 65536;
+
+    SidRecorder() = default;
+    SidRecorder(const SidRecorder&) = delete;
+    SidRecorder &operator=(const SidRecorder&) = delete;
+    ~SidRecorder();
+
+    // start recording into a new file and the worker that writes it (not
+    // on the audio thread); fails while the previous recording is still
+    // being written
+    bool start(const std::string &path, std::string &error);
+    // the audio thread ends the log with its next update() and the worker
+    // frees the ring once it is written, a recording the audio thread has
+    // not begun yet is closed and released right away and leaves no file
+    void stop();
+    bool isRecording()
+    {
+        int s = state.load(std::memory_order_acquire);
+        return s == STATE_STARTED || s == STATE_RECORDING;
+    }
+    // events lost due to a full ring in the current or last recording
+    uint32_t getDropped() { return dropped.load(std::memory_order_relaxed); }
+
+    // audio thread: follow start() and stop() once per sample before the
+    // events are queued, true if a recording begins and all registers have
+    // to be written again
+    bool update(reSID::chip_model model, float clockHz);
+    bool isCapturing() { return capturing; }
+
+    // audio thread (via SidRenderer): events at a cycle of the current sample
+    void write(uint32_t cycle, uint8_t offset, uint8_t value);
+    void input(uint32_t cycle, int16_t value);
+    // audio thread: the current sample is finished
+    void advance(uint32_t cycles) { time += cycles; }
+
+protected:
+    struct Event {
+        uint64_t cycle;
+        uint8_t  code;
+        int16_t  value;
+    };
+    static constexpr uint8_t CODE_BEGIN = 0xfd;
+
+    // a recording passes all states in order, only start() and stop() of
+    // the UI thread and update() of the audio thread move it on, and the
+    // worker once the log is written
+    enum State {
+        STATE_IDLE,
+        // file opened, the audio thread begins with its next update()
+        STATE_STARTED,
+        STATE_RECORDING,
+        // the audio thread ends the log with its next update()
+        STATE_STOPPED,
+        // end pushed, the worker closes the file
+        STATE_ENDED
+    };
+
+    void push(uint64_t cycle, uint8_t code, int16_t value);
+    void run();
+    // true once the end of the log is written
+    bool drain();
+    // UI thread: end the worker, it frees the ring if it wrote the end
+    void join();
+    void putVarint(uint64_t value);
+
+    std::atomic<int> state{STATE_IDLE};
+    std::atomic<uint32_t> dropped{0};
+    // UI thread until the audio thread begins, then the worker
+    FILE *file = nullptr;
+    std::string path;
+
+    // audio thread
+    bool capturing = false;
+    uint64_t time = 0;
+    // header values, published with the begin event
+    uint8_t model = 0;
+    uint32_t clock = 0;
+
+    // single producer (audio thread), single consumer (worker); allocated
+    // by start(), freed by the worker after the end event or by stop() and
+    // the destructor once the worker is joined
+    Event *ring = nullptr;
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+
+    // worker
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool running = true;
+    bool logging = false;
+    uint64_t lastCycle = 0;
+};
@@ -0,0 +1,337 @@
+#include "sid_renderer.h"
+#include "sid_recorder.h"
+
+void SidRenderer::configure(int size, reSID::cycle_count steps, bool directMode,
+    int cycles, int delay)
+{
+    if(size < 1) {
+        size = 1;
+    } else if(size > MAX_BLOCK_SIZE) {
+        size = MAX_BLOCK_SIZE;
+    }
+    blockSize = size;
+    cyclesPerSample = steps > 0 ? steps : 1;
+    direct = directMode;
+    writeCycles = cycles > 0 ? cycles : 0;
+    writeDelay = delay > 0 ? delay : 0;
+    reset();
+}
+
+void SidRenderer::reset()
+{
+    pos = 0;
+    numEvents = 0;
+    hasInput = false;
+    for(int i=0;i<MAX_BLOCK_SIZE;i++) {
+        audio[i] = 0;
+        voice3Osc[i] = 0;
+        voice3Env[i] = 0;
+    }
+    sample = 0;
+    osc = 0;
+    env = 0;
+}
+
+void SidRenderer::resume(int position)
+{
+    pos = position;
+    reSID::cycle_count start = pos * cyclesPerSample;
+    for(int i=0;i<numEvents;i++) {
+        events[i].cycle = start;
+    }
+    // the block rendered before the pause is stale
+    for(int i=0;i<MAX_BLOCK_SIZE;i++) {
+        audio[i] = 0;
+        voice3Osc[i] = 0;
+        voice3Env[i] = 0;
+    }
+}
+
+void SidRenderer::write(uint8_t offset, uint8_t value)
+{
+    if(numEvents == MAX_EVENTS) {
+        return;
+    }
+    // spread the writes like the stores of a CPU, a long update spills
+    // into the next sample (and block)
+    reSID::cycle_count start = pos * cyclesPerSample;
+    reSID::cycle_count cycle = start + writeDelay;
+    // behind the last write still running in this sample, an aux input
+    // change may be queued after it
+    int i = numEvents - 1;
+    while(i >= 0 && events[i].offset == EVENT_INPUT && (reSID::cycle_count)events[i].cycle >= start) {
+        i--;
+    }
+    if(i >= 0 && events[i].offset != EVENT_INPUT && (reSID::cycle_count)events[i].cycle >= start) {
+        cycle = events[i].cycle + writeCycles;
+    } else if(numEvents > 0 && (reSID::cycle_count)events[numEvents - 1].cycle > cycle) {
+        cycle = events[numEvents - 1].cycle;
+    }
+    // but no further, so the writes can't fall behind when every sample
+    // has more of them than fit
+    if(cycle > start + 2 * cyclesPerSample - 1) {
+        cycle = start + 2 * cyclesPerSample - 1;
+    }
+    Event &ev = events[numEvents++];
+    ev.cycle = cycle;
+    ev.offset = offset;
+    ev.value = value;
+    if(recorder) {
+        recorder->write(cycle - start, offset, value);
+    }
+}
+
+void SidRenderer::input(int16_t sample)
+{
+    if(hasInput && sample == lastInput) {
+        return;
+    }
+    if(numEvents == MAX_EVENTS) {
+        return;
+    }
+    hasInput = true;
+    lastInput = sample;
+    // keep the queue ordered behind writes of this sample
+    uint32_t cycle = pos * cyclesPerSample;
+    if(numEvents > 0 && events[numEvents - 1].cycle > cycle) {
+        cycle = events[numEvents - 1].cycle;
+    }
+    Event &ev = events[numEvents++];
+    ev.cycle = cycle;
+    ev.offset = EVENT_INPUT;
+    ev.value = sample;
+    if(recorder) {
+        recorder->input(cycle - pos * cyclesPerSample, sample);
+    }
+}
+
+int16_t SidRenderer::process(reSID::SID &sid)
+{
+    if(advance()) {
+        render(sid);
+    }
+    return sample;
+}
+
+bool SidRenderer::advance()
+{
+    if(recorder) {
+        recorder->advance(cyclesPerSample);
+    }
+    int i = pos++;
+    // return sample of the previous block
+    // (zero latency: render() provides the sample)
+    if(blockSize > 1) {
+        sample = audio[i];
+        osc = voice3Osc[i];
+        env = voice3Env[i];
+    }
+    return pos == blockSize;
+}
+
+void SidRenderer::render(reSID::SID &sid)
+{
+    reSID::cycle_count blockCycles = blockSize * cyclesPerSample;
+    reSID::cycle_count cycle = 0;
+    int e = 0;
+    int n = 0;
+
+    while(cycle < blockCycles) {
+        // apply all events due at this cycle
+        while(e < numEvents && (reSID::cycle_count)events[e].cycle <= cycle) {
+            const Event &ev = events[e++];
+            if(ev.offset == EVENT_INPUT) {
+                sid.input(ev.value);
+            } else {
+                sid.write(ev.offset, (uint8_t)ev.value);
+            }
+        }
+
+        // clock uninterrupted up to the next event
+        reSID::cycle_count end = e < numEvents ? (reSID::cycle_count)events[e].cycle : blockCycles;
+        if(end > blockCycles) {
+            end = blockCycles;
+        }
+        if(readVoice3) {
+            reSID::cycle_count sampleEnd = (cycle / cyclesPerSample + 1) * cyclesPerSample;
+            if(end > sampleEnd) {
+                end = sampleEnd;
+            }
+        }
+        int first = n;
+        n = renderSpan(sid, cycle, end, n);
+
+        // voice 3 registers are sampled at the end of the span
+        uint8_t spanOsc = sid.read(0x1b);
+        uint8_t spanEnv = sid.read(0x1c);
+        for(int i=first;i<n;i++) {
+            voice3Osc[i] = spanOsc;
+            voice3Env[i] = spanEnv;
+        }
+
+        cycle = end;
+    }
+
+    finish(n);
+}
+
+void SidRenderer::finish(int n)
+{
+    // the first block after configuration is one sample short in the
+    // resample modes: pad with silence in front to keep the timing aligned
+    if(n < blockSize) {
+        int pad = blockSize - n;
+        for(int i=blockSize-1;i>=pad;i--) {
+            audio[i] = audio[i - pad];
+            voice3Osc[i] = voice3Osc[i - pad];
+            voice3Env[i] = voice3Env[i - pad];
+        }
+        for(int i=0;i<pad;i++) {
+            audio[i] = 0;
+            voice3Osc[i] = 0;
+            voice3Env[i] = 0;
+        }
+    }
+
+    // carry the writes spilled past the block into the next one
+    reSID::cycle_count blockCycles = blockSize * cyclesPerSample;
+    int num = 0;
+    for(int i=0;i<numEvents;i++) {
+        if((reSID::cycle_count)events[i].cycle >= blockCycles) {
+            events[num] = events[i];
+            events[num].cycle -= blockCycles;
+            num++;
+        }
+    }
+    numEvents = num;
+    pos = 0;
+
+    if(blockSize == 1) {
+        sample = audio[0];
+        osc = voice3Osc[0];
+        env = voice3Env[0];
+    }
+}
+
+int SidRenderer::renderSpan(reSID::SID &sid, reSID::cycle_count cycle, reSID::cycle_count end, int n)
+{
+    if(direct) {
+        // pick the output at the end of each sample
+        while(cycle < end) {
+            reSID::cycle_count sampleEnd = (cycle / cyclesPerSample + 1) * cyclesPerSample;
+            reSID::cycle_count next = end < sampleEnd ? end : sampleEnd;
+            sid.clock(next - cycle);
+            cycle = next;
+            if(cycle == sampleEnd) {
+                audio[n++] = sid.output();
+            }
+        }
+        return n;
+    }
+
+    // the resampler emits a sample once its first cycle has been clocked,
+    // so a block yields exactly blockSize samples, except the first one
+    reSID::cycle_count delta = end - cycle;
+    while(delta) {
+        if(n < blockSize) {
+            n += sid.clock(delta, &audio[n], blockSize - n);
+        } else {
+            // drop surplus sample
+            short dummy;
+            sid.clock(delta, &dummy, 1);
+        }
+    }
+    return n;
+}
+
+void SidRenderer::renderBank(SidRenderer **renderers, reSID::SIDBank &bank)
+{
+    int num = bank.chips();
+    const SidRenderer &first = *renderers[0];
+    reSID::cycle_count cyclesPerSample = first.cyclesPerSample;
+    int blockSize = first.blockSize;
+    reSID::cycle_count blockCycles = blockSize * cyclesPerSample;
+
+    // position in the events and the span of each chip as in render()
+    int e[reSID::SIDBank::MAX_CHIPS] = { 0 };
+    reSID::cycle_count spanEnd[reSID::SIDBank::MAX_CHIPS];
+    int spanFirst[reSID::SIDBank::MAX_CHIPS];
+    short *buf[reSID::SIDBank::MAX_CHIPS];
+    short dummy[reSID::SIDBank::MAX_CHIPS];
+    reSID::cycle_count cycle = 0;
+    int n = 0;
+
+    for(int k=0;k<num;k++) {
+        spanEnd[k] = 0;
+    }
+
+    while(cycle < blockCycles) {
+        // apply the events of all chips due at this cycle and clock all
+        // chips up to the end of the shortest span
+        reSID::cycle_count end = blockCycles;
+        for(int k=0;k<num;k++) {
+            SidRenderer &r = *renderers[k];
+            if(spanEnd[k] == cycle) {
+                reSID::SID &sid = *bank.chip(k);
+                while(e[k] < r.numEvents && (reSID::cycle_count)r.events[e[k]].cycle <= cycle) {
+                    const Event &ev = r.events[e[k]++];
+                    if(ev.offset == EVENT_INPUT) {
+                        sid.input(ev.value);
+                    } else {
+                        sid.write(ev.offset, (uint8_t)ev.value);
+                    }
+                }
+                spanEnd[k] = e[k] < r.numEvents ? (reSID::cycle_count)r.events[e[k]].cycle : blockCycles;
+                if(spanEnd[k] > blockCycles) {
+                    spanEnd[k] = blockCycles;
+                }
+                if(r.readVoice3) {
+                    reSID::cycle_count sampleEnd = (cycle / cyclesPerSample + 1) * cyclesPerSample;
+                    if(spanEnd[k] > sampleEnd) {
+                        spanEnd[k] = sampleEnd;
+                    }
+                }
+                spanFirst[k] = n;
+            }
+            if(spanEnd[k] < end) {
+                end = spanEnd[k];
+            }
+        }
+
+        // see renderSpan()
+        reSID::cycle_count delta = end - cycle;
+        while(delta) {
+            if(n < blockSize) {
+                for(int k=0;k<num;k++) {
+                    buf[k] = &renderers[k]->audio[n];
+                }
+                n += bank.clock(delta, buf, blockSize - n);
+            } else {
+                for(int k=0;k<num;k++) {
+                    buf[k] = &dummy[k];
+                }
+                bank.clock(delta, buf, 1);
+            }
+        }
+        cycle = end;
+
+        // voice 3 registers are sampled at the end of the span of each chip
+        for(int k=0;k<num;k++) {
+            if(spanEnd[k] != cycle) {
+                continue;
+            }
+            SidRenderer &r = *renderers[k];
+            reSID::SID &sid = *bank.chip(k);
+            uint8_t spanOsc = sid.read(0x1b);
+            uint8_t spanEnv = sid.read(0x1c);
+            for(int i=spanFirst[k];i<n;i++) {
+                r.voice3Osc[i] = spanOsc;
+                r.voice3Env[i] = spanEnv;
+            }
+        }
+    }
+
+    for(int k=0;k<num;k++) {
+        renderers[k]->finish(n);
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include "sid.h"
+#include "sidbank.h"
+
+struct SidRecorder;
+
+// Renders the SID in blocks of several output samples.
+// Register writes and aux input changes are queued with their cycle offset
+// inside the current block and applied while clocking, so the chip is only
+// stopped at events instead of once per sample. A block size of 1 renders
+// each sample immediately (zero latency), larger blocks add a latency of
+// block size samples.
+// The writes of one sample are spread like the stores of a CPU, each
+// writeCycles after the previous one. Writes that do not fit into the sample
+// land in the next one (also across the block end), so the output does not
+// depend on the block size.
+struct SidRenderer {
+    static constexpr int MAX_BLOCK_SIZE = 256;
+    // all 25 registers plus the aux input may change in every sample
+    static constexpr int MAX_EVENTS = MAX_BLOCK_SIZE * 26;
+    static constexpr uint8_t EVENT_INPUT = 0xff;
+    // cycles of a 6502 STA absolute
+    static constexpr int WRITE_CYCLES = 4;
+
+    struct Event {
+        uint32_t cycle;
+        uint8_t  offset;
+        int16_t  value;
+    };
+
+    int blockSize = 1;
+    reSID::cycle_count cyclesPerSample = 1;
+    // clock with delta cycles and pick the output (SAMPLE_DIRECT)
+    bool direct = true;
+    // cycles between the writes of one sample
+    int writeCycles = WRITE_CYCLES;
+    // cycles until the first write of a sample lands
+    // (the write pipeline of the MOS8580)
+    int writeDelay = 0;
+    // sample voice 3 osc/env for every output sample
+    bool readVoice3 = true;
+    // records the queued events if set
+    SidRecorder *recorder = nullptr;
+
+    // position of the current sample in the block
+    int pos = 0;
+    Event events[MAX_EVENTS];
+    int numEvents = 0;
+    int16_t lastInput = 0;
+    bool hasInput = false;
+
+    // rendered block
+    int16_t audio[MAX_BLOCK_SIZE];
+    uint8_t voice3Osc[MAX_BLOCK_SIZE];
+    uint8_t voice3Env[MAX_BLOCK_SIZE];
+
+    // output of the sample finished by advance()
+    int16_t sample = 0;
+    uint8_t osc = 0;
+    uint8_t env = 0;
+
+    void configure(int blockSize, reSID::cycle_count cyclesPerSample, bool direct,
+        int writeCycles = WRITE_CYCLES, int writeDelay = 0);
+    void reset();
+    // continue after a pause at the position of the running block, the
+    // events queued before the pause are applied at the current sample
+    void resume(int position);
+
+    // queue events for the current sample
+    void write(uint8_t offset, uint8_t value);
+    void input(int16_t sample);
+
+    // finish the current sample and return its audio output
+    int16_t process(reSID::SID &sid);
+
+    // split form of process() for rendering blocks elsewhere:
+    // finish the current sample, true if render() must be called now
+    bool advance();
+    // render the completed block
+    void render(reSID::SID &sid);
+
+    // render the completed blocks of several renderers with the same
+    // configuration, clocking their chips in lockstep in a bank
+    static void renderBank(SidRenderer **renderers, reSID::SIDBank &bank);
+
+    int getLatency() { return blockSize > 1 ? blockSize : 0; }
+
+protected:
+    // clock from cycle to end and store the finished samples from audio[n],
+    // returns the new number of samples
+    int renderSpan(reSID::SID &sid, reSID::cycle_count cycle, reSID::cycle_count end, int n);
+    // the samples of the block are complete, pad if short and start the next
+    void finish(int n);
+};
@@ -1,9 +1,11 @@
 #include <iomanip>
 
+#include <osdialog.h>
+
 #include "plugin.hpp"
-#include "sid.h"
-#include "voice_regs.h"
-#include "filter_regs.h"
+#include "sid_dump.h"
+#include "sid_engine.h"
+#include "sid_recorder.h"
 
 struct Sidofon : Module {
     enum ParamIds {
@@ -69,6 +71,10 @@ struct Sidofon : Module {
         CLOCK_INPUT,
         NUM_INPUTS
     };
+    // the voice and filter controls share the index of their param and
+    // input, so one bit mask tracks both
+    static_assert((int)VOLUME_PARAM == (int)VOLUME_INPUT, "control ids differ");
+    static_assert(NUM_INPUTS <= 64, "control mask too small");
     enum OutputIds {
         AUDIO_OUTPUT,
         CLOCK_OUTPUT,
@@ -126,17 +132,20 @@ struct Sidofon : Module {
     static constexpr float vsyncHzPAL = 50.0f;
     static constexpr float vsyncHzNTSC = 60.0f;
     float cpuClockHz = cpuClockHzPAL;
-    float cpuClockRealHz = cpuClockHzPAL;
     float vsyncHz = vsyncHzPAL;
     float vsyncOversample = 1;
     float sampleRate = 0.0;
 
-    reSID::SID sid;
     SIDType sidType = MOS8580;
     SampleMode sampleMode = SAMPLE_DIRECT;
-    reSID::cycle_count cpuClockSteps = 0;
-    VoiceRegs voiceRegs[VoiceRegs::NUM_VOICES];
-    FilterRegs filterRegs;
+    int blockSize = 1;
+    bool polyphonic = false;
+    int renderThreads = 1;
+    // active engine, replaced at a block boundary by a reconfigured one
+    SidEngine *engine = nullptr;
+    SidEngineBuilder builder;
+    // chips played in the last sample, their blocks advance in lockstep
+    int activeChannels = 0;
 
     // clock in
     dsp::SchmittTrigger clkInDetector;
@@ -146,11 +155,68 @@ struct Sidofon : Module {
     float vsyncPeriod;
     static constexpr float triggerTime = 1e-4f;
 
+    // register dump playback: the frames replace the CVs of the first SID
+    SidDumpPlayer dumpPlayer;
+    SidDumpStream *dump = nullptr;
+    std::string dumpPath;
+    bool dumpLoop = false;
+    // registers of the current frame
+    uint8_t dumpRegs[SidDumpStream::FRAME_SIZE];
+    bool dumpValid = false;
+    float dumpCounter = 0.0;
+
+    // records the register writes of the first SID
+    SidRecorder recorder;
+
+    // controls at the last register update: the knob values and a bit per
+    // connected input. changedControls marks the controls whose register
+    // field must be mapped again: knob moved or input connected (or just
+    // disconnected).
+    float paramValues[NUM_PARAMS];
+    uint64_t connectedInputs = 0;
+    uint64_t changedControls = 0;
+
+    // lights show the registers of the first SID: their brightness is only
+    // recomputed when the registers are updated and smoothed towards it
+    // every lightDivision samples
+    float lightValues[NUM_LIGHTS] = {};
+    dsp::ClockDivider lightDivider;
+    int lightDivision = 16;
+
+    // engine state in the patch: the audio thread takes a snapshot at a
+    // block boundary about once a second and dataToJson() saves the latest
+    // one. The snapshots are triple buffered: the audio thread fills the
+    // back one and swaps it with the middle one, dataToJson() takes the
+    // middle one if it is fresh, so neither thread waits for the other.
+    // The audio thread replaces a back one that is not sized for its
+    // engine with one the engine brought along (SidEngine::takeState()).
+    static constexpr int SNAPSHOT_FRESH = 4;
+    SidEngineState *snapshots[3] = { nullptr, nullptr, nullptr };
+    int snapshotBack = 0;
+    std::atomic<int> snapshotMiddle{1};
+    int snapshotFront = 2;
+    float snapshotCounter = 0.f;
+    // a loaded state is restored by the builder into the next engine and
+    // saved as loaded until there is a snapshot of an engine built after it
+    SidEngineState *loadedState = nullptr;
+    std::string loadedStateData;
+    uint32_t loadedStateSerial = 0;
+    // dataFromJson() applies all settings before it requests one engine
+    bool loading = false;
+    bool resetPending = false;
+
     // Json I/O
     static constexpr const char *JSON_CPU_TYPE_KEY = "CPUType";
     static constexpr const char *JSON_SID_TYPE_KEY = "SIDType";
     static constexpr const char *JSON_VSYNC_OVERSAMPLE_KEY = "VSyncOversample";
     static constexpr const char *JSON_SAMPLE_MODE_KEY = "SampleMode";
+    static constexpr const char *JSON_BLOCK_SIZE_KEY = "BlockSize";
+    static constexpr const char *JSON_POLYPHONIC_KEY = "Polyphonic";
+    static constexpr const char *JSON_RENDER_THREADS_KEY = "RenderThreads";
+    static constexpr const char *JSON_DUMP_FILE_KEY = "DumpFile";
+    static constexpr const char *JSON_DUMP_LOOP_KEY = "DumpLoop";
+    static constexpr const char *JSON_ENGINE_STATE_KEY = "EngineState";
+    static constexpr const char *JSON_LIGHT_DIVISION_KEY = "LightDivision";
 
     Sidofon() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -222,6 +288,20 @@ struct Sidofon : Module {
         configOutput(CLOCK_OUTPUT, "SID Register Update Clock");
         configOutput(VOICE3_ENV, "Voice 3 Envelope");
         configOutput(VOICE3_OSC, "Voice 3 Oscillator");
+
+        lightDivider.setDivision(lightDivision);
+        for(int i=0;i<NUM_PARAMS;i++) {
+            paramValues[i] = NAN;
+        }
+    }
+
+    ~Sidofon() {
+        delete engine;
+        for(int i=0;i<3;i++) {
+            delete snapshots[i];
+        }
+        delete loadedState;
+        // the dump player deletes all streams
     }
 
     void setCPUType(CPUType type)
@@ -263,14 +343,80 @@ struct Sidofon : Module {
         }
     }
 
-    inline uint16_t freq2sidreg(float freq)
+    void setPolyphonic(bool on)
+    {
+        if(on != polyphonic) {
+            polyphonic = on;
+            reset();
+        }
+    }
+
+    void setRenderThreads(int num)
+    {
+        if(num != renderThreads) {
+            renderThreads = num;
+            reset();
+        }
+    }
+
+    void setBlockSize(int size)
+    {
+        if(size != blockSize) {
+            blockSize = size;
+            reset();
+        }
+    }
+
+    void setLightDivision(int division)
+    {
+        lightDivision = clamp(division, 1, 1024);
+        lightDivider.setDivision(lightDivision);
+    }
+
+    // map the dump here and let the player thread fill its ring before
+    // process() swaps it in
+    void loadDump(const std::string &path)
+    {
+        SidDumpStream *stream = new SidDumpStream();
+        std::string error;
+        if(!stream->open(path, dumpLoop, error)) {
+            WARN("Sidofon: can't play register dump %s: %s", path.c_str(), error.c_str());
+            delete stream;
+            return;
+        }
+        dumpPath = path;
+        dumpPlayer.request(stream);
+    }
+
+    void stopDump()
     {
-        return (uint16_t)roundf(freq * 16777216.0f / cpuClockRealHz);
+        dumpPath.clear();
+        // a stream that is not open stops the playback
+        dumpPlayer.request(new SidDumpStream());
+    }
+
+    void startRecording(const std::string &path)
+    {
+        std::string error;
+        if(!recorder.start(path, error)) {
+            WARN("Sidofon: can't record to %s: %s", path.c_str(), error.c_str());
+        }
+    }
+
+    void stopRecording()
+    {
+        recorder.stop();
+    }
+
+    // takes effect with the next load or restart
+    void setDumpLoop(bool on)
+    {
+        dumpLoop = on;
     }
 
     inline float sidreg2freq(uint16_t val)
     {
-        return val * cpuClockRealHz / 16777216.0f;
+        return val * engine->cpuClockRealHz / 16777216.0f;
     }
 
     void reset()
@@ -279,33 +425,14 @@ struct Sidofon : Module {
         if(sampleRate == 0.0) {
             return;
         }
+        if(loading) {
+            resetPending = true;
+            return;
+        }
 
         vsyncCounter = 0.0;
         vsyncPeriod = sampleRate / vsyncHz;
 
-#ifdef DEBUG_SID
-        printf("SID reset: sidType=%d cpuClockHz=%f sampleRate=%f\n", sidType, cpuClockHz, sampleRate);
-#endif
-        sid.reset();
-
-        bool is6581 = (sidType == MOS6581);
-
-        // configure SID
-        sid.set_chip_model(is6581 ? reSID::MOS6581 : reSID::MOS8580);
-        // enable 3 voices and aux
-        sid.set_voice_mask(0xf);
-        sid.enable_filter(true);
-        sid.adjust_filter_bias(is6581 ? 0.5 : 0.0);
-        sid.enable_external_filter(true);
-
-        // CPU clock steps between audio samples
-        cpuClockSteps = (reSID::cycle_count)roundf(cpuClockHz / sampleRate);
-        // by performing these clock steps what is the real clock hz used
-        cpuClockRealHz = cpuClockSteps * sampleRate;
-#ifdef DEBUG_SID
-        printf("cpuClockSteps: %d, cpuClockRealHz=%f\n", cpuClockSteps, cpuClockRealHz);
-#endif
-
         // map sample mode
         reSID::sampling_method samplingMethod;
         switch(sampleMode) {
@@ -321,197 +448,365 @@ struct Sidofon : Module {
                 break;
         }
 
-        sid.set_sampling_parameters(cpuClockRealHz, samplingMethod, sampleRate);
+        SidEngine::Config cfg;
+        cfg.chipModel = (sidType == MOS6581) ? reSID::MOS6581 : reSID::MOS8580;
+        cfg.samplingMethod = samplingMethod;
+        cfg.direct = (sampleMode == SAMPLE_DIRECT);
+        cfg.cpuClockHz = cpuClockHz;
+        cfg.sampleRate = sampleRate;
+        cfg.blockSize = blockSize;
+        cfg.numChannels = polyphonic ? SidEngine::MAX_CHANNELS : 1;
+        cfg.numThreads = renderThreads;
 
-        for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
-            voiceRegs[i].reset();
+#ifdef DEBUG_SID
+        printf("SID reset: sidType=%d cpuClockHz=%f sampleRate=%f\n", sidType, cpuClockHz, sampleRate);
+#endif
+        // the new engine is built off the audio thread and swapped in
+        // by process() while the current one keeps playing
+        builder.request(cfg, loadedState);
+        loadedState = nullptr;
+    }
+
+    // latest snapshot of the engine as base64, the loaded state until its
+    // engine took one or empty if none was taken
+    std::string saveEngineState()
+    {
+        if(snapshotMiddle.load(std::memory_order_acquire) & SNAPSHOT_FRESH) {
+            snapshotFront = snapshotMiddle.exchange(snapshotFront, std::memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+        }
+        const SidEngineState *state = snapshots[snapshotFront];
+        if(!loadedStateData.empty()) {
+            if(state == nullptr || state->serial != loadedStateSerial) {
+                return loadedStateData;
+            }
+            loadedStateData.clear();
+        }
+        if(state == nullptr || state->numChannels == 0) {
+            return "";
+        }
+        std::vector<uint8_t> bytes = state->serialize();
+        return string::toBase64(bytes.data(), bytes.size());
+    }
+
+    void loadEngineState(const std::string &base64)
+    {
+        SidEngineState *state = new SidEngineState();
+        std::vector<uint8_t> data;
+        try {
+            data = string::fromBase64(base64);
+        }
+        catch(Exception &e) {
+            // rejected as empty data below
+        }
+        if(!state->deserialize(data.data(), data.size())) {
+            WARN("Sidofon: ignoring invalid engine state");
+            delete state;
+            return;
+        }
+        state->serial = ++loadedStateSerial;
+        delete loadedState;
+        loadedState = state;
+        loadedStateData = base64;
+    }
+
+    static uint64_t controlBit(int id)
+    {
+        return (uint64_t)1 << id;
+    }
+
+    // once per register update instead of reading every control of every
+    // channel
+    void refreshControls()
+    {
+        uint64_t connected = 0;
+        for(int i=0;i<NUM_INPUTS;i++) {
+            if(inputs[i].isConnected()) {
+                connected |= controlBit(i);
+            }
         }
-        filterRegs.reset();
+        uint64_t changed = connected | connectedInputs;
+        for(int i=0;i<NUM_PARAMS;i++) {
+            float val = params[i].getValue();
+            if(val != paramValues[i]) {
+                paramValues[i] = val;
+                changed |= controlBit(i);
+            }
+        }
+        connectedInputs = connected;
+        changedControls = changed;
     }
 
-    bool getSwitchValue(int inputId, int paramId)
+    bool getSwitchValue(int inputId, int paramId, int channel)
     {
-        float val = params[paramId].getValue();
-        if(inputs[inputId].isConnected()) {
-            val += inputs[inputId].getVoltage();
+        float val = paramValues[paramId];
+        if(connectedInputs & controlBit(inputId)) {
+            val += inputs[inputId].getPolyVoltage(channel);
         }
         return val >= 1.0f;
     }
 
-    uint8_t getByteValue(int inputId, int paramId, int max)
+    uint8_t getByteValue(int inputId, int paramId, int max, int channel)
     {
-        float val = params[paramId].getValue();
-        if(inputs[inputId].isConnected()) {
-            val += inputs[inputId].getVoltage() / 10.0f;
+        float val = paramValues[paramId];
+        if(connectedInputs & controlBit(inputId)) {
+            val += inputs[inputId].getPolyVoltage(channel) / 10.0f;
         }
         val = clamp(val * (float)max, 0.f, (float)max);
         return (uint8_t)val;
     }
 
-    uint16_t getLoHiValue(int inputId, int paramId, int max)
+    uint16_t getLoHiValue(int inputId, int paramId, int max, int channel)
     {
-        float val = params[paramId].getValue();
-        if(inputs[inputId].isConnected()) {
-            val += inputs[inputId].getVoltage() / 10.0f;
+        float val = paramValues[paramId];
+        if(connectedInputs & controlBit(inputId)) {
+            val += inputs[inputId].getPolyVoltage(channel) / 10.0f;
         }
         val = clamp(val * (float)max, 0.f, (float)max);
         return (uint16_t)val;
     }
 
-    void updateVoice(int voiceNo)
+    int16_t getAuxValue(int channel)
     {
-        VoiceRegs &regs = voiceRegs[voiceNo];
+        if(inputs[AUX_INPUT].isConnected()) {
+            float val = inputs[AUX_INPUT].getPolyVoltage(channel) / 5.0f;
+            val = clamp(val, -1.0f, 1.0f);
+            return (int16_t)(val * 32767.0f);
+        } else {
+            if(sidType == MOS8580_DIGI) {
+                return -32768;
+            } else {
+                return 0;
+            }
+        }
+    }
 
-        // update pitch
-        float pitchKnob = params[PITCH_PARAM + voiceNo].getValue();
-        float pitchCV = 12.f * inputs[PITCH_INPUT + voiceNo].getVoltage();
-        float pitch = dsp::FREQ_C4 * std::pow(2.f, (pitchKnob + pitchCV) / 12.f);
-        uint16_t pitchReg = freq2sidreg(pitch);
+    // map the controls marked in changed to the registers of a voice
+    void updateVoice(SidChannel &ch, int voiceNo, int channel, uint64_t changed)
+    {
+        VoiceRegs &regs = ch.voiceRegs[voiceNo];
+
+        // update pitch: mapped only when knob or CV moved
+        if(changed & controlBit(PITCH_PARAM + voiceNo)) {
+            float pitchKnob = paramValues[PITCH_PARAM + voiceNo];
+            float pitchCV = 12.f * inputs[PITCH_INPUT + voiceNo].getPolyVoltage(channel);
+            float pitch = pitchKnob + pitchCV;
+            if(pitch != ch.pitch[voiceNo]) {
+                ch.pitch[voiceNo] = pitch;
+                uint16_t pitchReg = engine->pitchTable.getFreqReg(pitch);
 #ifdef DEBUG_SID
-        bool changedPitch = regs.setFreq(pitchReg);
-        if(changedPitch) {
-            float pitchGot = sidreg2freq(pitchReg);
-            float error = abs(pitchGot - pitch);
-            printf("Pitch#%d: freq=%f -> reg=$%04x -> freq=%f, error=%f\n", voiceNo,
-                pitch, pitchReg, pitchGot, error);
-        }
+                bool changedPitch = regs.setFreq(pitchReg);
+                if(changedPitch) {
+                    float freq = dsp::FREQ_C4 * std::pow(2.f, pitch / 12.f);
+                    float freqGot = sidreg2freq(pitchReg);
+                    float error = abs(freqGot - freq);
+                    printf("Pitch#%d.%d: freq=%f -> reg=$%04x -> freq=%f, error=%f\n", channel, voiceNo,
+                        freq, pitchReg, freqGot, error);
+                }
 #else
-        regs.setFreq(pitchReg);
+                regs.setFreq(pitchReg);
 #endif
+            }
+        }
 
         // update pulse width
-        float pwKnob = params[PULSE_WIDTH_PARAM + voiceNo].getValue();
-        float pwInput = inputs[PULSE_WIDTH_INPUT + voiceNo].getVoltage();
-        float pw = (clamp(pwKnob + pwInput / 5.0f, -1.0f, 1.0f) + 1.0f) / 2.0f;
-        uint16_t pwVal = (uint16_t)(pw * VoiceRegs::PULSE_WIDTH_MAX);
-        regs.setPulseWidth(pwVal);
+        if(changed & controlBit(PULSE_WIDTH_PARAM + voiceNo)) {
+            float pwKnob = paramValues[PULSE_WIDTH_PARAM + voiceNo];
+            float pwInput = inputs[PULSE_WIDTH_INPUT + voiceNo].getPolyVoltage(channel);
+            float pw = (clamp(pwKnob + pwInput / 5.0f, -1.0f, 1.0f) + 1.0f) / 2.0f;
+            uint16_t pwVal = (uint16_t)(pw * VoiceRegs::PULSE_WIDTH_MAX);
+            regs.setPulseWidth(pwVal);
+        }
 
         // update waveform
-        uint8_t waveform = 0;
-        bool tri = getSwitchValue(WAVE_TRI_INPUT + voiceNo, WAVE_TRI_PARAM + voiceNo);
-        bool saw = getSwitchValue(WAVE_SAW_INPUT + voiceNo, WAVE_SAW_PARAM + voiceNo);
-        bool pulse = getSwitchValue(WAVE_PULSE_INPUT + voiceNo, WAVE_PULSE_PARAM + voiceNo);
-        bool noise = getSwitchValue(WAVE_NOISE_INPUT + voiceNo, WAVE_NOISE_PARAM + voiceNo);
-        if(tri) waveform |= VoiceRegs::WAVE_TRIANGLE;
-        if(saw) waveform |= VoiceRegs::WAVE_SAWTOOTH;
-        if(pulse) waveform |= VoiceRegs::WAVE_RECTANGLE;
-        if(noise) waveform |= VoiceRegs::WAVE_NOISE;
-        regs.setWaveform(waveform);
+        uint64_t waveControls = controlBit(WAVE_TRI_PARAM + voiceNo) | controlBit(WAVE_SAW_PARAM + voiceNo)
+            | controlBit(WAVE_PULSE_PARAM + voiceNo) | controlBit(WAVE_NOISE_PARAM + voiceNo);
+        if(changed & waveControls) {
+            uint8_t waveform = 0;
+            bool tri = getSwitchValue(WAVE_TRI_INPUT + voiceNo, WAVE_TRI_PARAM + voiceNo, channel);
+            bool saw = getSwitchValue(WAVE_SAW_INPUT + voiceNo, WAVE_SAW_PARAM + voiceNo, channel);
+            bool pulse = getSwitchValue(WAVE_PULSE_INPUT + voiceNo, WAVE_PULSE_PARAM + voiceNo, channel);
+            bool noise = getSwitchValue(WAVE_NOISE_INPUT + voiceNo, WAVE_NOISE_PARAM + voiceNo, channel);
+            if(tri) waveform |= VoiceRegs::WAVE_TRIANGLE;
+            if(saw) waveform |= VoiceRegs::WAVE_SAWTOOTH;
+            if(pulse) waveform |= VoiceRegs::WAVE_RECTANGLE;
+            if(noise) waveform |= VoiceRegs::WAVE_NOISE;
+            regs.setWaveform(waveform);
+        }
 
         // update gate
-        bool gate = getSwitchValue(GATE_INPUT + voiceNo, GATE_PARAM + voiceNo);
-        regs.setGate(gate);
+        if(changed & controlBit(GATE_PARAM + voiceNo)) {
+            bool gate = getSwitchValue(GATE_INPUT + voiceNo, GATE_PARAM + voiceNo, channel);
+            regs.setGate(gate);
+        }
 
         // update sync
-        bool sync = getSwitchValue(SYNC_INPUT + voiceNo, SYNC_PARAM + voiceNo);
-        regs.setSync(sync);
+        if(changed & controlBit(SYNC_PARAM + voiceNo)) {
+            bool sync = getSwitchValue(SYNC_INPUT + voiceNo, SYNC_PARAM + voiceNo, channel);
+            regs.setSync(sync);
+        }
 
         // update ringmod
-        bool ringMod = getSwitchValue(RING_MOD_INPUT + voiceNo, RING_MOD_PARAM + voiceNo);
-        regs.setRingMod(ringMod);
+        if(changed & controlBit(RING_MOD_PARAM + voiceNo)) {
+            bool ringMod = getSwitchValue(RING_MOD_INPUT + voiceNo, RING_MOD_PARAM + voiceNo, channel);
+            regs.setRingMod(ringMod);
+        }
 
         // update test
-        bool test = getSwitchValue(TEST_INPUT + voiceNo, TEST_PARAM + voiceNo);
-        regs.setTest(test);
+        if(changed & controlBit(TEST_PARAM + voiceNo)) {
+            bool test = getSwitchValue(TEST_INPUT + voiceNo, TEST_PARAM + voiceNo, channel);
+            regs.setTest(test);
+        }
 
         // update ADSR
-        regs.setAttack(getByteValue(ATTACK_INPUT + voiceNo, ATTACK_PARAM + voiceNo, VoiceRegs::ATTACK_MAX));
-        regs.setDecay(getByteValue(DECAY_INPUT + voiceNo, DECAY_PARAM + voiceNo, VoiceRegs::DECAY_MAX));
-        regs.setSustain(getByteValue(SUSTAIN_INPUT + voiceNo, SUSTAIN_PARAM + voiceNo, VoiceRegs::SUSTAIN_MAX));
-        regs.setRelease(getByteValue(RELEASE_INPUT + voiceNo, RELEASE_PARAM + voiceNo, VoiceRegs::RELEASE_MAX));
+        if(changed & controlBit(ATTACK_PARAM + voiceNo)) {
+            regs.setAttack(getByteValue(ATTACK_INPUT + voiceNo, ATTACK_PARAM + voiceNo, VoiceRegs::ATTACK_MAX, channel));
+        }
+        if(changed & controlBit(DECAY_PARAM + voiceNo)) {
+            regs.setDecay(getByteValue(DECAY_INPUT + voiceNo, DECAY_PARAM + voiceNo, VoiceRegs::DECAY_MAX, channel));
+        }
+        if(changed & controlBit(SUSTAIN_PARAM + voiceNo)) {
+            regs.setSustain(getByteValue(SUSTAIN_INPUT + voiceNo, SUSTAIN_PARAM + voiceNo, VoiceRegs::SUSTAIN_MAX, channel));
+        }
+        if(changed & controlBit(RELEASE_PARAM + voiceNo)) {
+            regs.setRelease(getByteValue(RELEASE_INPUT + voiceNo, RELEASE_PARAM + voiceNo, VoiceRegs::RELEASE_MAX, channel));
+        }
     }
 
-    void updateVoiceLights(int voiceNo, float sampleTime)
+    void updateVoiceLights(int voiceNo)
     {
-        VoiceRegs &regs = voiceRegs[voiceNo];
+        // lights show the first channel
+        VoiceRegs &regs = engine->channels[0].voiceRegs[voiceNo];
 
         uint8_t waveform = regs.getWaveform();
         bool tri = (waveform & VoiceRegs::WAVE_TRIANGLE) == VoiceRegs::WAVE_TRIANGLE;
         bool saw = (waveform & VoiceRegs::WAVE_SAWTOOTH) == VoiceRegs::WAVE_SAWTOOTH;
         bool pulse = (waveform & VoiceRegs::WAVE_RECTANGLE) == VoiceRegs::WAVE_RECTANGLE;
         bool noise = (waveform & VoiceRegs::WAVE_NOISE) == VoiceRegs::WAVE_NOISE;
-        lights[WAVE_TRI_LIGHT + voiceNo].setSmoothBrightness(tri, sampleTime);
-        lights[WAVE_SAW_LIGHT + voiceNo].setSmoothBrightness(saw, sampleTime);
-        lights[WAVE_PULSE_LIGHT + voiceNo].setSmoothBrightness(pulse, sampleTime);
-        lights[WAVE_NOISE_LIGHT + voiceNo].setSmoothBrightness(noise, sampleTime);
-
-        lights[GATE_LIGHT + voiceNo].setSmoothBrightness(regs.getGate(), sampleTime);
-        lights[SYNC_LIGHT + voiceNo].setSmoothBrightness(regs.getSync(), sampleTime);
-        lights[RING_MOD_LIGHT + voiceNo].setSmoothBrightness(regs.getRingMod(), sampleTime);
-        lights[TEST_LIGHT + voiceNo].setSmoothBrightness(regs.getTest(), sampleTime);
-
-        lights[ATTACK_LIGHT + voiceNo].setSmoothBrightness((float)regs.getAttack() / 15.0f, sampleTime);
-        lights[DECAY_LIGHT + voiceNo].setSmoothBrightness((float)regs.getDecay() / 15.0f, sampleTime);
-        lights[SUSTAIN_LIGHT + voiceNo].setSmoothBrightness((float)regs.getSustain() / 15.0f, sampleTime);
-        lights[RELEASE_LIGHT + voiceNo].setSmoothBrightness((float)regs.getRelease() / 15.0f, sampleTime);
+        lightValues[WAVE_TRI_LIGHT + voiceNo] = tri;
+        lightValues[WAVE_SAW_LIGHT + voiceNo] = saw;
+        lightValues[WAVE_PULSE_LIGHT + voiceNo] = pulse;
+        lightValues[WAVE_NOISE_LIGHT + voiceNo] = noise;
+
+        lightValues[GATE_LIGHT + voiceNo] = regs.getGate();
+        lightValues[SYNC_LIGHT + voiceNo] = regs.getSync();
+        lightValues[RING_MOD_LIGHT + voiceNo] = regs.getRingMod();
+        lightValues[TEST_LIGHT + voiceNo] = regs.getTest();
+
+        lightValues[ATTACK_LIGHT + voiceNo] = (float)regs.getAttack() / 15.0f;
+        lightValues[DECAY_LIGHT + voiceNo] = (float)regs.getDecay() / 15.0f;
+        lightValues[SUSTAIN_LIGHT + voiceNo] = (float)regs.getSustain() / 15.0f;
+        lightValues[RELEASE_LIGHT + voiceNo] = (float)regs.getRelease() / 15.0f;
     }
 
-    void updateFilter()
+    // map the controls marked in changed to the filter registers
+    void updateFilter(SidChannel &ch, int channel, uint64_t changed)
     {
-        bool voice1 = getSwitchValue(FILTER_VOICE1_INPUT, FILTER_VOICE1_PARAM);
-        filterRegs.setFilterVoice(0, voice1);
-        bool voice2 = getSwitchValue(FILTER_VOICE2_INPUT, FILTER_VOICE2_PARAM);
-        filterRegs.setFilterVoice(1, voice2);
-        bool voice3 = getSwitchValue(FILTER_VOICE3_INPUT, FILTER_VOICE3_PARAM);
-        filterRegs.setFilterVoice(2, voice3);
-        bool ext = getSwitchValue(FILTER_AUX_INPUT, FILTER_AUX_PARAM);
-        filterRegs.setFilterExt(ext);
+        FilterRegs &filterRegs = ch.filterRegs;
+
+        if(changed & controlBit(FILTER_VOICE1_PARAM)) {
+            bool voice1 = getSwitchValue(FILTER_VOICE1_INPUT, FILTER_VOICE1_PARAM, channel);
+            filterRegs.setFilterVoice(0, voice1);
+        }
+        if(changed & controlBit(FILTER_VOICE2_PARAM)) {
+            bool voice2 = getSwitchValue(FILTER_VOICE2_INPUT, FILTER_VOICE2_PARAM, channel);
+            filterRegs.setFilterVoice(1, voice2);
+        }
+        if(changed & controlBit(FILTER_VOICE3_PARAM)) {
+            bool voice3 = getSwitchValue(FILTER_VOICE3_INPUT, FILTER_VOICE3_PARAM, channel);
+            filterRegs.setFilterVoice(2, voice3);
+        }
+        if(changed & controlBit(FILTER_AUX_PARAM)) {
+            bool ext = getSwitchValue(FILTER_AUX_INPUT, FILTER_AUX_PARAM, channel);
+            filterRegs.setFilterExt(ext);
+        }
 
-        bool lp = getSwitchValue(FILTER_LO_PASS_INPUT, FILTER_LO_PASS_PARAM);
-        bool bp = getSwitchValue(FILTER_BAND_PASS_INPUT, FILTER_BAND_PASS_PARAM);
-        bool hp = getSwitchValue(FILTER_HI_PASS_INPUT, FILTER_HI_PASS_PARAM);
-        uint8_t mode = 0;
-        if(lp) mode |= FilterRegs::MODE_LP;
-        if(bp) mode |= FilterRegs::MODE_BP;
-        if(hp) mode |= FilterRegs::MODE_HP;
-        filterRegs.setMode(mode);
+        uint64_t modeControls = controlBit(FILTER_LO_PASS_PARAM) | controlBit(FILTER_BAND_PASS_PARAM)
+            | controlBit(FILTER_HI_PASS_PARAM);
+        if(changed & modeControls) {
+            bool lp = getSwitchValue(FILTER_LO_PASS_INPUT, FILTER_LO_PASS_PARAM, channel);
+            bool bp = getSwitchValue(FILTER_BAND_PASS_INPUT, FILTER_BAND_PASS_PARAM, channel);
+            bool hp = getSwitchValue(FILTER_HI_PASS_INPUT, FILTER_HI_PASS_PARAM, channel);
+            uint8_t mode = 0;
+            if(lp) mode |= FilterRegs::MODE_LP;
+            if(bp) mode |= FilterRegs::MODE_BP;
+            if(hp) mode |= FilterRegs::MODE_HP;
+            filterRegs.setMode(mode);
+        }
 
-        bool v3off = getSwitchValue(VOICE3OFF_INPUT, VOICE3OFF_PARAM);
-        filterRegs.setVoice3Off(v3off);
+        if(changed & controlBit(VOICE3OFF_PARAM)) {
+            bool v3off = getSwitchValue(VOICE3OFF_INPUT, VOICE3OFF_PARAM, channel);
+            filterRegs.setVoice3Off(v3off);
+        }
 
-        uint16_t cutoff = getLoHiValue(FILTER_CUTOFF_INPUT, FILTER_CUTOFF_PARAM, FilterRegs::CUTOFF_MAX);
-        filterRegs.setCutOff(cutoff);
+        if(changed & controlBit(FILTER_CUTOFF_PARAM)) {
+            uint16_t cutoff = getLoHiValue(FILTER_CUTOFF_INPUT, FILTER_CUTOFF_PARAM, FilterRegs::CUTOFF_MAX, channel);
+            filterRegs.setCutOff(cutoff);
+        }
 
-        uint8_t  res = getByteValue(FILTER_RESONANCE_INPUT, FILTER_RESONANCE_PARAM, FilterRegs::RESONANCE_MAX);
-        filterRegs.setResonance(res);
+        if(changed & controlBit(FILTER_RESONANCE_PARAM)) {
+            uint8_t  res = getByteValue(FILTER_RESONANCE_INPUT, FILTER_RESONANCE_PARAM, FilterRegs::RESONANCE_MAX, channel);
+            filterRegs.setResonance(res);
+        }
 
-        uint8_t  vol = getByteValue(VOLUME_INPUT, VOLUME_PARAM, FilterRegs::VOLUME_MAX);
-        filterRegs.setVolume(vol);
+        if(changed & controlBit(VOLUME_PARAM)) {
+            uint8_t  vol = getByteValue(VOLUME_INPUT, VOLUME_PARAM, FilterRegs::VOLUME_MAX, channel);
+            filterRegs.setVolume(vol);
+        }
     }
 
-    void updateFilterLights(float sampleTime)
+    void updateFilterLights()
     {
-        lights[FILTER_VOICE1_LIGHT].setSmoothBrightness(filterRegs.getFilterVoice(0), sampleTime);
-        lights[FILTER_VOICE2_LIGHT].setSmoothBrightness(filterRegs.getFilterVoice(1), sampleTime);
-        lights[FILTER_VOICE3_LIGHT].setSmoothBrightness(filterRegs.getFilterVoice(2), sampleTime);
-        lights[FILTER_AUX_LIGHT].setSmoothBrightness(filterRegs.getFilterExt(), sampleTime);
+        FilterRegs &filterRegs = engine->channels[0].filterRegs;
+
+        lightValues[FILTER_VOICE1_LIGHT] = filterRegs.getFilterVoice(0);
+        lightValues[FILTER_VOICE2_LIGHT] = filterRegs.getFilterVoice(1);
+        lightValues[FILTER_VOICE3_LIGHT] = filterRegs.getFilterVoice(2);
+        lightValues[FILTER_AUX_LIGHT] = filterRegs.getFilterExt();
 
         uint8_t mode = filterRegs.getMode();
         bool lp = (mode & FilterRegs::MODE_LP) == FilterRegs::MODE_LP;
         bool bp = (mode & FilterRegs::MODE_BP) == FilterRegs::MODE_BP;
         bool hp = (mode & FilterRegs::MODE_HP) == FilterRegs::MODE_HP;
-        lights[FILTER_LO_PASS_LIGHT].setSmoothBrightness(lp, sampleTime);
-        lights[FILTER_BAND_PASS_LIGHT].setSmoothBrightness(bp, sampleTime);
-        lights[FILTER_HI_PASS_LIGHT].setSmoothBrightness(hp, sampleTime);
+        lightValues[FILTER_LO_PASS_LIGHT] = lp;
+        lightValues[FILTER_BAND_PASS_LIGHT] = bp;
+        lightValues[FILTER_HI_PASS_LIGHT] = hp;
 
-        lights[VOICE3OFF_LIGHT].setSmoothBrightness(filterRegs.getVoice3Off(), sampleTime);
+        lightValues[VOICE3OFF_LIGHT] = filterRegs.getVoice3Off();
 
         float cutoff = (float)filterRegs.getCutOff() / (float)FilterRegs::CUTOFF_MAX;
-        lights[FILTER_CUTOFF_LIGHT].setSmoothBrightness(cutoff, sampleTime);
+        lightValues[FILTER_CUTOFF_LIGHT] = cutoff;
 
         float resonance = (float)filterRegs.getResonance() / (float)FilterRegs::RESONANCE_MAX;
-        lights[FILTER_RESONANCE_LIGHT].setSmoothBrightness(resonance, sampleTime);
+        lightValues[FILTER_RESONANCE_LIGHT] = resonance;
 
         float volume = (float)filterRegs.getVolume() / (float)FilterRegs::VOLUME_MAX;
-        lights[VOLUME_LIGHT].setSmoothBrightness(volume, sampleTime);
+        lightValues[VOLUME_LIGHT] = volume;
     }
 
-    void updateLights(float sampleTime) {
-        // realize changed SID regs
+    void updateLights() {
         for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
-            updateVoiceLights(i,sampleTime);
+            updateVoiceLights(i);
+        }
+        updateFilterLights();
+    }
+
+    void smoothLights(float deltaTime) {
+        for(int i=0;i<NUM_LIGHTS;i++) {
+            lights[i].setSmoothBrightness(lightValues[i], deltaTime);
         }
-        updateFilterLights(sampleTime);
+    }
+
+    // all played chips are at the start of a block
+    bool atBlockBoundary() {
+        if(engine == nullptr) {
+            return true;
+        }
+        for(int c=0;c<activeChannels;c++) {
+            if(engine->channels[c].renderer.pos != 0) {
+                return false;
+            }
+        }
+        return true;
     }
 
     void process(const ProcessArgs& args) override {
@@ -520,24 +815,77 @@ struct Sidofon : Module {
             setSampleRate(args.sampleRate);
         }
 
-        // feed in aux
-        int16_t aux_value;
-        if(inputs[AUX_INPUT].isConnected()) {
-            float val = inputs[AUX_INPUT].getVoltage() / 5.0f;
-            val = clamp(val, -1.0f, 1.0f);
-            aux_value = (int16_t)(val * 32767.0f);
-        } else {
-            if(sidType == MOS8580_DIGI) {
-                aux_value = -32768;
+        // swap in a reconfigured engine at a block boundary
+        bool engineChanged = false;
+        if(atBlockBoundary()) {
+            SidEngine *next = builder.fetch();
+            if(next) {
+                if(engine) {
+                    builder.retire(engine);
+                }
+                engine = next;
+                activeChannels = 0;
+                engineChanged = true;
+                // snapshot of the new engine right away
+                snapshotCounter = sampleRate;
+            }
+        }
+        // snapshot for the patch at a block boundary
+        snapshotCounter++;
+        if(snapshotCounter >= sampleRate && engine && atBlockBoundary()) {
+            snapshotCounter = 0.f;
+            SidEngineState *&state = snapshots[snapshotBack];
+            if(!engine->ownsState(state)) {
+                engine->dropState(state);
+                state = engine->takeState();
+            }
+            if(state) {
+                engine->saveState(*state);
+                snapshotBack = snapshotMiddle.exchange(snapshotBack | SNAPSHOT_FRESH, std::memory_order_acq_rel)
+                    & ~SNAPSHOT_FRESH;
+            }
+        }
+        // not ready yet
+        if(engine == nullptr) {
+            outputs[AUDIO_OUTPUT].setVoltage(0.f);
+            outputs[VOICE3_OSC].setVoltage(0.f);
+            outputs[VOICE3_ENV].setVoltage(0.f);
+            return;
+        }
+
+        // one SID per channel of the pitch/gate inputs in poly mode
+        int channels = 1;
+        if(polyphonic) {
+            for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
+                channels = std::max(channels, inputs[PITCH_INPUT + i].getChannels());
+                channels = std::max(channels, inputs[GATE_INPUT + i].getChannels());
+            }
+            channels = std::min(channels, engine->numChannels);
+        }
+        // chips played again join the running block of the others
+        for(int c=std::max(activeChannels, 1);c<channels;c++) {
+            engine->resume(c);
+        }
+        activeChannels = channels;
+
+        // swap in a new register dump
+        SidDumpStream *nextDump = dumpPlayer.fetch();
+        if(nextDump) {
+            dumpPlayer.retire(dump);
+            dump = nullptr;
+            if(nextDump->isOpen()) {
+                dump = nextDump;
             } else {
-                aux_value = 0;
+                dumpPlayer.retire(nextDump);
             }
+            dumpValid = false;
+            dumpCounter = 0.0;
         }
-        sid.input(aux_value);
 
         // check register update clock
         bool update = false;
-        if(inputs[CLOCK_INPUT].isConnected()) {
+        bool extClock = inputs[CLOCK_INPUT].isConnected();
+        if(extClock) {
             // external clock
             float clkIn = inputs[CLOCK_INPUT].getVoltage();
             update = clkInDetector.process(clkIn);
@@ -556,47 +904,139 @@ struct Sidofon : Module {
             vsyncCounter++;
         }
 
-        // update SID regs?
-        if(update) {
-            // uptdate voices
+        // next dump frame on each external clock or vsync, a dump has one
+        // frame per vsync so the oversampling does not apply
+        bool dumpFrame = false;
+        if(dump) {
+            bool next = false;
+            if(extClock) {
+                next = update;
+            } else {
+                if(dumpCounter > vsyncPeriod) {
+                    dumpCounter -= vsyncPeriod;
+                    next = true;
+                }
+                dumpCounter++;
+            }
+            SidDumpStream::Step step = dump->step(next, dumpRegs);
+            if(step == SidDumpStream::STEP_FRAME) {
+                dumpValid = true;
+                dumpFrame = true;
+            }
+            // back to the CVs after the last frame
+            else if(step == SidDumpStream::STEP_END) {
+                dumpPlayer.retire(dump);
+                dump = nullptr;
+                dumpValid = false;
+            }
+        }
+
+        // write all registers of a new engine right away
+        if(engineChanged) {
+            update = true;
+        }
+
+        // a new recording starts with all registers and the aux input
+        SidChannel &first = engine->channels[0];
+        if(recorder.update(engine->config.chipModel, engine->cpuClockRealHz)) {
             for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
-                updateVoice(i);
-                voiceRegs[i].realize(sid, i);
+                first.voiceRegs[i].dirty = 0xff;
             }
-            // update filter
-            updateFilter();
-            filterRegs.realize(sid);
+            first.filterRegs.dirty = 0xff;
+            first.renderer.hasInput = false;
+            update = true;
+        }
+        first.renderer.recorder = recorder.isCapturing() ? &recorder : nullptr;
 
-            // trigger clock out pulse
-            clkOutPulseGen.trigger(triggerTime);
+        bool readVoice3 = outputs[VOICE3_OSC].isConnected() || outputs[VOICE3_ENV].isConnected();
+
+        if(update) {
+            refreshControls();
+            // chips beyond the channels miss the changes of this update
+            for(int c=channels;c<engine->numChannels;c++) {
+                engine->channels[c].controlsMapped = false;
+            }
         }
 
-        updateLights(args.sampleTime);
+        // queue register updates of all chips and collect the ones
+        // that completed a block
+        for(int c=0;c<channels;c++) {
+            SidChannel &ch = engine->channels[c];
+            SidRenderer &renderer = ch.renderer;
+
+            // feed in aux
+            renderer.input(getAuxValue(c));
+
+            // update SID regs from the dump
+            if(c == 0 && dumpValid) {
+                if(update || dumpFrame) {
+                    for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
+                        ch.voiceRegs[i].setRegs(dumpRegs + i * VoiceRegs::NUM_REGS);
+                        ch.voiceRegs[i].realize(renderer, i);
+                        // the CVs map the pitch again after the dump
+                        ch.pitch[i] = NAN;
+                    }
+                    ch.filterRegs.setRegs(dumpRegs + VoiceRegs::NUM_VOICES * VoiceRegs::NUM_REGS);
+                    ch.filterRegs.realize(renderer);
+                    // and all other controls
+                    ch.controlsMapped = false;
+                }
+            }
+            // update SID regs?
+            else if(update) {
+                uint64_t changed = ch.controlsMapped ? changedControls : ~(uint64_t)0;
+                // uptdate voices
+                for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
+                    updateVoice(ch, i, c, changed);
+                    ch.voiceRegs[i].realize(renderer, i);
+                }
+                // update filter
+                updateFilter(ch, c, changed);
+                ch.filterRegs.realize(renderer);
+                ch.controlsMapped = true;
+            }
 
-        // emulate SID for some CPU clocks and retrieve output sample
-        int16_t sample;
-        if(sampleMode == SAMPLE_DIRECT) {
-            sid.clock(cpuClockSteps);
-            sample = sid.output();
-        } else {
-            reSID::cycle_count steps = cpuClockSteps;
-            while(steps) {
-                sid.clock(steps, &sample, 1);
+            renderer.readVoice3 = readVoice3;
+            if(renderer.advance()) {
+                engine->renderIds[engine->numRenderIds++] = c;
             }
         }
 
-        // Update Voice3 Outputs: Oscillator and Envelope
-        uint8_t voice3_osc = sid.read(0x1b);
-        float voice3_osc_f = voice3_osc * 10.f / 255.f - 5.f; // bipolar
-        outputs[VOICE3_OSC].setVoltage(voice3_osc_f);
+        // emulate SIDs for some CPU clocks (rendered block wise with the
+        // configured latency and spread across the render threads)
+        engine->render();
 
-        uint8_t voice3_env = sid.read(0x1c);
-        float voice3_env_f = voice3_env * 10.f / 255.f; // unipolar
-        outputs[VOICE3_ENV].setVoltage(voice3_env_f);
+        // retrieve output samples
+        for(int c=0;c<channels;c++) {
+            SidRenderer &renderer = engine->channels[c].renderer;
+            int16_t sample = renderer.sample;
 
-        // Audio out: retrieve SID audio sample and convert to voltage
-        float audio = sample * 20.0f / 32768.0f;
-        outputs[AUDIO_OUTPUT].setVoltage(audio);
+            // Update Voice3 Outputs: Oscillator and Envelope
+            uint8_t voice3_osc = renderer.osc;
+            float voice3_osc_f = voice3_osc * 10.f / 255.f - 5.f; // bipolar
+            outputs[VOICE3_OSC].setVoltage(voice3_osc_f, c);
+
+            uint8_t voice3_env = renderer.env;
+            float voice3_env_f = voice3_env * 10.f / 255.f; // unipolar
+            outputs[VOICE3_ENV].setVoltage(voice3_env_f, c);
+
+            // Audio out: retrieve SID audio sample and convert to voltage
+            float audio = sample * 20.0f / 32768.0f;
+            outputs[AUDIO_OUTPUT].setVoltage(audio, c);
+        }
+        outputs[AUDIO_OUTPUT].setChannels(channels);
+        outputs[VOICE3_OSC].setChannels(channels);
+        outputs[VOICE3_ENV].setChannels(channels);
+
+        if(update || dumpFrame) {
+            // trigger clock out pulse
+            clkOutPulseGen.trigger(triggerTime);
+            updateLights();
+        }
+
+        if(lightDivider.process()) {
+            smoothLights(args.sampleTime * lightDivider.getDivision());
+        }
 
         // Clock out
         float triggerValue = clkOutPulseGen.process(args.sampleTime);
@@ -609,10 +1049,29 @@ struct Sidofon : Module {
         json_object_set_new(rootJ, JSON_SID_TYPE_KEY, json_integer(sidType));
         json_object_set_new(rootJ, JSON_VSYNC_OVERSAMPLE_KEY, json_integer(vsyncOversample));
         json_object_set_new(rootJ, JSON_SAMPLE_MODE_KEY, json_integer(sampleMode));
+        json_object_set_new(rootJ, JSON_BLOCK_SIZE_KEY, json_integer(blockSize));
+        json_object_set_new(rootJ, JSON_POLYPHONIC_KEY, json_boolean(polyphonic));
+        json_object_set_new(rootJ, JSON_RENDER_THREADS_KEY, json_integer(renderThreads));
+        json_object_set_new(rootJ, JSON_DUMP_FILE_KEY, json_string(dumpPath.c_str()));
+        json_object_set_new(rootJ, JSON_DUMP_LOOP_KEY, json_boolean(dumpLoop));
+        json_object_set_new(rootJ, JSON_LIGHT_DIVISION_KEY, json_integer(lightDivision));
+        std::string state = saveEngineState();
+        if(!state.empty()) {
+            json_object_set_new(rootJ, JSON_ENGINE_STATE_KEY, json_string(state.c_str()));
+        }
         return rootJ;
     }
 
     void dataFromJson(json_t *rootJ) override {
+        // request the engine once with all settings below
+        loading = true;
+        resetPending = false;
+        loadedStateData.clear();
+        // taken by the engine request
+        json_t *esJ = json_object_get(rootJ, JSON_ENGINE_STATE_KEY);
+        if (esJ && json_string_length(esJ) > 0) {
+            loadEngineState(json_string_value(esJ));
+        }
         json_t *cpuTypeJ = json_object_get(rootJ, JSON_CPU_TYPE_KEY);
         if (cpuTypeJ) {
             CPUType type = (CPUType)json_integer_value(cpuTypeJ);
@@ -632,6 +1091,35 @@ struct Sidofon : Module {
             SampleMode sampleMode = (SampleMode)json_integer_value(smJ);
             setSampleMode(sampleMode);
         }
+        json_t *bsJ = json_object_get(rootJ, JSON_BLOCK_SIZE_KEY);
+        if (bsJ) {
+            setBlockSize(json_integer_value(bsJ));
+        }
+        json_t *polyJ = json_object_get(rootJ, JSON_POLYPHONIC_KEY);
+        if (polyJ) {
+            setPolyphonic(json_boolean_value(polyJ));
+        }
+        json_t *rtJ = json_object_get(rootJ, JSON_RENDER_THREADS_KEY);
+        if (rtJ) {
+            setRenderThreads(json_integer_value(rtJ));
+        }
+        json_t *dlJ = json_object_get(rootJ, JSON_DUMP_LOOP_KEY);
+        if (dlJ) {
+            setDumpLoop(json_boolean_value(dlJ));
+        }
+        json_t *ldJ = json_object_get(rootJ, JSON_LIGHT_DIVISION_KEY);
+        if (ldJ) {
+            setLightDivision(json_integer_value(ldJ));
+        }
+        json_t *dfJ = json_object_get(rootJ, JSON_DUMP_FILE_KEY);
+        if (dfJ && json_string_length(dfJ) > 0) {
+            loadDump(json_string_value(dfJ));
+        }
+        loading = false;
+        // same configuration: restore into a fresh engine anyway
+        if (resetPending || loadedState) {
+            reset();
+        }
     }
 };
 
@@ -699,6 +1187,123 @@ struct SampleModeMenuItem : MenuItem {
     }
 };
 
+struct BlockSizeMenuItem : MenuItem {
+    Sidofon *module;
+    int blockSize;
+
+    BlockSizeMenuItem(Sidofon *mod, const std::string &name, int bs)
+    : module(mod), blockSize(bs)
+    {
+        text = name;
+        rightText = CHECKMARK(module->blockSize == bs);
+    }
+
+    void onAction(const event::Action &e) override{
+        module->setBlockSize(blockSize);
+    }
+};
+
+struct PolyphonicMenuItem : MenuItem {
+    Sidofon *module;
+    bool polyphonic;
+
+    PolyphonicMenuItem(Sidofon *mod, const std::string &name, bool poly)
+    : module(mod), polyphonic(poly)
+    {
+        text = name;
+        rightText = CHECKMARK(module->polyphonic == poly);
+    }
+
+    void onAction(const event::Action &e) override{
+        module->setPolyphonic(polyphonic);
+    }
+};
+
+struct RenderThreadsMenuItem : MenuItem {
+    Sidofon *module;
+    int renderThreads;
+
+    RenderThreadsMenuItem(Sidofon *mod, const std::string &name, int num)
+    : module(mod), renderThreads(num)
+    {
+        text = name;
+        rightText = CHECKMARK(module->renderThreads == num);
+    }
+
+    void onAction(const event::Action &e) override{
+        module->setRenderThreads(renderThreads);
+    }
+};
+
+struct LightDivisionMenuItem : MenuItem {
+    Sidofon *module;
+    int division;
+
+    LightDivisionMenuItem(Sidofon *mod, const std::string &name, int div)
+    : module(mod), division(div)
+    {
+        text = name;
+        rightText = CHECKMARK(module->lightDivision == div);
+    }
+
+    void onAction(const event::Action &e) override{
+        module->setLightDivision(division);
+    }
+};
+
+struct LoadDumpMenuItem : MenuItem {
+    Sidofon *module;
+    void onAction(const event::Action &e) override{
+        osdialog_filters *filters = osdialog_filters_parse("Register Dump:dmp,bin;All Files:*");
+        char *path = osdialog_file(OSDIALOG_OPEN, NULL, NULL, filters);
+        osdialog_filters_free(filters);
+        if(path) {
+            module->loadDump(path);
+            free(path);
+        }
+    }
+};
+
+struct RestartDumpMenuItem : MenuItem {
+    Sidofon *module;
+    void onAction(const event::Action &e) override{
+        if(!module->dumpPath.empty()) {
+            module->loadDump(module->dumpPath);
+        }
+    }
+};
+
+struct StopDumpMenuItem : MenuItem {
+    Sidofon *module;
+    void onAction(const event::Action &e) override{
+        module->stopDump();
+    }
+};
+
+struct DumpLoopMenuItem : MenuItem {
+    Sidofon *module;
+    void onAction(const event::Action &e) override{
+        module->setDumpLoop(!module->dumpLoop);
+    }
+};
+
+struct RecordMenuItem : MenuItem {
+    Sidofon *module;
+    void onAction(const event::Action &e) override{
+        if(module->recorder.isRecording()) {
+            module->stopRecording();
+            return;
+        }
+        osdialog_filters *filters = osdialog_filters_parse("Register Log:sidw");
+        char *path = osdialog_file(OSDIALOG_SAVE, NULL, "sidofon.sidw", filters);
+        osdialog_filters_free(filters);
+        if(path) {
+            module->startRecording(path);
+            free(path);
+        }
+    }
+};
+
 struct ResetMenuItem : MenuItem {
     Sidofon *module;
     void onAction(const event::Action &e) override{
@@ -849,6 +1454,14 @@ struct SidofonWidget : ModuleWidget {
         menu->addChild(new SIDTypeMenuItem(module,
             "MOS 8580 (Digi Boost)", Sidofon::MOS8580_DIGI));
 
+        // Polyphony
+        MenuLabel *polyLabel = new MenuLabel();
+        polyLabel->text = "Polyphony";
+        menu->addChild(polyLabel);
+
+        menu->addChild(new PolyphonicMenuItem(module, "Mono (single SID)", false));
+        menu->addChild(new PolyphonicMenuItem(module, "Poly (one SID per Pitch/Gate channel)", true));
+
         // CPU Clock
         MenuLabel *cpuLabel = new MenuLabel();
         cpuLabel->text = "CPU Clock";
@@ -880,6 +1493,77 @@ struct SidofonWidget : ModuleWidget {
         menu->addChild(new SampleModeMenuItem(module, "Interpolate", Sidofon::SAMPLE_INTERPOLATE));
         menu->addChild(new SampleModeMenuItem(module, "Resample", Sidofon::SAMPLE_RESAMPLE));
         menu->addChild(new SampleModeMenuItem(module, "Resample Fastmem", Sidofon::SAMPLE_RESAMPLE_FASTMEM));
+
+        // Render Latency
+        MenuLabel *bsLabel = new MenuLabel();
+        bsLabel->text = "Render Latency";
+        menu->addChild(bsLabel);
+
+        menu->addChild(new BlockSizeMenuItem(module, "None (per sample)", 1));
+        menu->addChild(new BlockSizeMenuItem(module, "32 samples", 32));
+        menu->addChild(new BlockSizeMenuItem(module, "64 samples", 64));
+        menu->addChild(new BlockSizeMenuItem(module, "128 samples", 128));
+        menu->addChild(new BlockSizeMenuItem(module, "256 samples", 256));
+
+        // Render Threads
+        MenuLabel *rtLabel = new MenuLabel();
+        rtLabel->text = "Render Threads (Poly)";
+        menu->addChild(rtLabel);
+
+        menu->addChild(new RenderThreadsMenuItem(module, "1 (audio thread only)", 1));
+        menu->addChild(new RenderThreadsMenuItem(module, "2", 2));
+        menu->addChild(new RenderThreadsMenuItem(module, "4", 4));
+        menu->addChild(new RenderThreadsMenuItem(module, "8", 8));
+
+        // Light Update
+        MenuLabel *ldLabel = new MenuLabel();
+        ldLabel->text = "Light Update";
+        menu->addChild(ldLabel);
+
+        menu->addChild(new LightDivisionMenuItem(module, "Every sample", 1));
+        menu->addChild(new LightDivisionMenuItem(module, "Every 16 samples", 16));
+        menu->addChild(new LightDivisionMenuItem(module, "Every 64 samples", 64));
+        menu->addChild(new LightDivisionMenuItem(module, "Every 256 samples", 256));
+
+        // Register Dump
+        MenuLabel *dumpLabel = new MenuLabel();
+        dumpLabel->text = "Register Dump";
+        menu->addChild(dumpLabel);
+
+        LoadDumpMenuItem *loadItem = new LoadDumpMenuItem();
+        loadItem->text = "Load...";
+        loadItem->rightText = system::getFilename(module->dumpPath);
+        loadItem->module = module;
+        menu->addChild(loadItem);
+
+        RestartDumpMenuItem *restartItem = new RestartDumpMenuItem();
+        restartItem->text = "Restart";
+        restartItem->module = module;
+        menu->addChild(restartItem);
+
+        DumpLoopMenuItem *loopItem = new DumpLoopMenuItem();
+        loopItem->text = "Loop";
+        loopItem->rightText = CHECKMARK(module->dumpLoop);
+        loopItem->module = module;
+        menu->addChild(loopItem);
+
+        StopDumpMenuItem *stopItem = new StopDumpMenuItem();
+        stopItem->text = "Stop";
+        stopItem->module = module;
+        menu->addChild(stopItem);
+
+        // Register Log
+        MenuLabel *recLabel = new MenuLabel();
+        recLabel->text = "Register Log";
+        menu->addChild(recLabel);
+
+        RecordMenuItem *recordItem = new RecordMenuItem();
+        recordItem->text = module->recorder.isRecording() ? "Stop Recording" : "Record...";
+        if(module->recorder.getDropped() > 0) {
+            recordItem->rightText = string::f("%u lost", module->recorder.getDropped());
+        }
+        recordItem->module = module;
+        menu->addChild(recordItem);
     }
 };
 
@@ -1,6 +1,8 @@
+#include <cstdio>
+
 #include "voice_regs.h"
 
-void VoiceRegs::realize(reSID::SID &sid, int voice_no)
+void VoiceRegs::realize(SidRenderer &renderer, int voice_no)
 {
     int offset = voice_no * NUM_REGS;
     int mask = 1;
@@ -12,7 +14,7 @@ void VoiceRegs::realize(reSID::SID &sid, int voice_no)
 #endif
     for(int i=0;i<NUM_REGS;i++) {
         if((dirty & mask) == mask) {
-            sid.write(offset, regs[i]);
+            renderer.write(offset, regs[i]);
 #ifdef DEBUG_SID
             printf(" @%02x=%02x", offset, regs[i]);
 #endif
@@ -35,6 +37,21 @@ void VoiceRegs::reset()
     dirty = 0xff;
 }
 
+void VoiceRegs::setRegs(const uint8_t *values)
+{
+    for(int i=0;i<NUM_REGS;i++) {
+        uint8_t value = values[i];
+        // unused bits like the setters
+        if(i == PW_HI) {
+            value &= 0xf;
+        }
+        if(regs[i] != value) {
+            regs[i] = value;
+            dirty |= 1<<i;
+        }
+    }
+}
+
 // 0..65535
 bool VoiceRegs::setFreq(uint16_t freq)
 {
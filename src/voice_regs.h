@@ -1,6 +1,6 @@
 #pragma once
-#include <rack.hpp>
-#include "sid.h"
+#include <cstdint>
+#include "sid_renderer.h"
 
 struct VoiceRegs {
     enum Regs {
@@ -37,8 +37,10 @@ struct VoiceRegs {
     static constexpr uint8_t  CTRL_TEST = 0x08;    
 
     // voice_no=0..2
-    void realize(reSID::SID &sid, int voice_no);
+    void realize(SidRenderer &renderer, int voice_no);
     void reset();
+    // all NUM_REGS registers at once, e.g. a frame of a register dump
+    void setRegs(const uint8_t *values);
 
     bool setFreq(uint16_t freq);
     void setPulseWidth(uint16_t pw);
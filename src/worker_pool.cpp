@@ -0,0 +1,130 @@
+#include "worker_pool.h"
+
+static constexpr uint64_t JOB_MASK = 0xffff;
+
+static inline uint32_t batchGeneration(uint64_t batch)
+{
+    return (uint32_t)(batch >> 32);
+}
+
+static inline int batchJobs(uint64_t batch)
+{
+    return (int)((batch >> 16) & JOB_MASK);
+}
+
+static inline int batchNextJob(uint64_t batch)
+{
+    return (int)(batch & JOB_MASK);
+}
+
+WorkerPool::WorkerPool(int numThreads)
+: sleeping(0), batch(0), done(0)
+{
+    for(int i=1;i<numThreads;i++) {
+        workers.push_back(std::thread(&WorkerPool::work, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cond.notify_all();
+    for(std::thread &t : workers) {
+        t.join();
+    }
+}
+
+void WorkerPool::run(JobFunc f, void *ctx, int n)
+{
+    if(n <= 0) {
+        return;
+    }
+    if(workers.empty() || n == 1) {
+        for(int i=0;i<n;i++) {
+            f(ctx, i);
+        }
+        return;
+    }
+
+    func = f;
+    context = ctx;
+    for(int first=0;first<n;first+=MAX_BATCH_JOBS) {
+        int num = n - first;
+        if(num > MAX_BATCH_JOBS) {
+            num = MAX_BATCH_JOBS;
+        }
+        runBatch(first, num);
+    }
+}
+
+void WorkerPool::runBatch(int firstJob, int n)
+{
+    jobOffset = firstJob;
+    done.store(0, std::memory_order_relaxed);
+
+    // publish the batch: new generation, its job count and first job 0.
+    // Workers of the previous batch can't claim a job of this one, as their
+    // compare and swap expects the old word.
+    uint64_t cur = batch.load(std::memory_order_relaxed);
+    uint64_t next = ((uint64_t)(batchGeneration(cur) + 1) << 32) | ((uint64_t)n << 16);
+    // A worker counts itself as sleeping before it checks the batch, both
+    // sequentially consistent like the store and the load here: either it
+    // sees the new batch, or it is counted and holds the mutex until it
+    // waits, so the notify below reaches it. Running workers pick up the
+    // batch without a wakeup.
+    batch.store(next, std::memory_order_seq_cst);
+    if(sleeping.load(std::memory_order_seq_cst) > 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        cond.notify_all();
+    }
+
+    runJobs(next);
+
+    // wait for the jobs still running on workers
+    while(done.load(std::memory_order_acquire) < n) {
+        std::this_thread::yield();
+    }
+}
+
+void WorkerPool::runJobs(uint64_t cur)
+{
+    uint32_t generation = batchGeneration(cur);
+    while(batchGeneration(cur) == generation && batchNextJob(cur) < batchJobs(cur)) {
+        // claim the job; fails if another thread was faster
+        if(!batch.compare_exchange_weak(cur, cur + 1, std::memory_order_acq_rel,
+            std::memory_order_acquire)) {
+            continue;
+        }
+        // the batch data stays valid until all claimed jobs are done
+        func(context, jobOffset + batchNextJob(cur));
+        done.fetch_add(1, std::memory_order_release);
+        cur = batch.load(std::memory_order_acquire);
+    }
+}
+
+void WorkerPool::work()
+{
+    uint32_t seen = 0;
+    while(true) {
+        uint64_t cur;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            cond.wait(lock, [&] {
+                return !running || batchGeneration(batch.load(std::memory_order_seq_cst)) != seen;
+            });
+            sleeping.fetch_sub(1, std::memory_order_relaxed);
+            if(!running) {
+                return;
+            }
+            cur = batch.load(std::memory_order_acquire);
+        }
+        seen = batchGeneration(cur);
+        runJobs(cur);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running batches of independent jobs.
+// The calling thread takes part in each batch and returns when all jobs are
+// done. Idle threads grab the next unclaimed job of the batch from a shared
+// lock-free counter, so the load balances itself and nothing is allocated
+// by the caller while running a batch. Idle workers sleep on a condition
+// variable and are counted, the caller only takes its mutex to wake them
+// while one of them is asleep.
+struct WorkerPool {
+    typedef void (*JobFunc)(void *context, int job);
+
+    // jobs of one batch; run() splits larger job counts into batches
+    static constexpr int MAX_BATCH_JOBS = 0xffff;
+
+    // numThreads includes the calling thread
+    WorkerPool(int numThreads);
+    ~WorkerPool();
+
+    void run(JobFunc func, void *context, int numJobs);
+
+    int getNumThreads() { return (int)workers.size() + 1; }
+
+protected:
+    void runBatch(int firstJob, int numJobs);
+    void work();
+    void runJobs(uint64_t cur);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool running = true;
+    // workers waiting on cond, counted under the mutex before they check
+    // for a new batch
+    std::atomic<int> sleeping;
+
+    // current batch: generation in the upper 32 bits, number of jobs in
+    // bits 16-31 and the next job in the lower 16 bits. A job can only be
+    // claimed with a compare and swap on the word of its own batch.
+    std::atomic<uint64_t> batch;
+    std::atomic<int> done;
+    // batch data, written before the batch word is published (release) and
+    // read after a job of the batch was claimed (acquire)
+    JobFunc func = nullptr;
+    void *context = nullptr;
+    int jobOffset = 0;
+};
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+#include "sid_log.h"
+
+static bool getVarint(const uint8_t *data, size_t size, size_t &pos, uint64_t &value)
+{
+    value = 0;
+    for(int shift=0;shift<64;shift+=7) {
+        if(pos >= size) {
+            return false;
+        }
+        uint8_t b = data[pos++];
+        value |= (uint64_t)(b & 0x7f) << shift;
+        if((b & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t getGcd(uint64_t a, uint64_t b)
+{
+    while(b) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+bool SidLog::load(const std::string &path, std::string &error)
+{
+    std::ifstream in(path, std::ios::binary);
+    if(!in) {
+        error = path + ": can't open";
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    name = path;
+    if(!parse(data.data(), data.size(), error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+bool SidLog::parse(const uint8_t *data, size_t size, std::string &error)
+{
+    events.clear();
+    endCycle = 0;
+    if(size < 10 || memcmp(data, "SIDW", 4) != 0) {
+        error = "no register log";
+        return false;
+    }
+    if(data[4] != SidRecorder::LOG_VERSION) {
+        error = "unsupported log version " + std::to_string(data[4]);
+        return false;
+    }
+    model = data[5] ? reSID::MOS8580 : reSID::MOS6581;
+    clockHz = data[6] | data[7] << 8 | data[8] << 16 | (uint32_t)data[9] << 24;
+    if(clockHz == 0) {
+        error = "invalid clock";
+        return false;
+    }
+
+    size_t pos = 10;
+    uint64_t cycle = 0;
+    while(pos < size) {
+        uint64_t delta;
+        if(!getVarint(data, size, pos, delta) || pos >= size) {
+            break;
+        }
+        cycle += delta;
+
+        Event ev;
+        ev.cycle = cycle;
+        ev.code = data[pos++];
+        ev.value = 0;
+        if(ev.code == SidRecorder::CODE_END) {
+            endCycle = cycle;
+            return true;
+        }
+        if(ev.code == SidRecorder::CODE_INPUT) {
+            if(pos + 2 > size) {
+                break;
+            }
+            ev.value = (int16_t)(data[pos] | data[pos + 1] << 8);
+            pos += 2;
+        } else if(ev.code <= 0x18) {
+            if(pos + 1 > size) {
+                break;
+            }
+            ev.value = data[pos++];
+        } else {
+            error = "invalid event code at byte " + std::to_string(pos - 1);
+            return false;
+        }
+        events.push_back(ev);
+    }
+    // the recording was cut off: play up to the last event
+    endCycle = cycle;
+    return true;
+}
+
+bool SidLogRenderer::setupChip(reSID::SID &sid, const SidLog &log)
+{
+    SidEngine::setupChip(sid, log.model);
+    return sid.set_sampling_parameters(log.clockHz, method->method, sampleRate)
+        && sampleRate < log.clockHz;
+}
+
+uint64_t SidLogRenderer::getGridCycles(const SidLog &log)
+{
+    // reSID advances the sample position by cycles per sample in 16.16
+    // fixed point (SID::FIXP_SHIFT), the fraction is zero again after
+    // 65536 / gcd samples
+    const uint64_t one = 1 << 16;
+    uint64_t fixp = (uint64_t)((double)log.clockHz / sampleRate * one + 0.5);
+    uint64_t samples = one / getGcd(fixp, one);
+    return samples * fixp / one;
+}
+
+void SidLogRenderer::clockTo(reSID::SID &sid, const SidLog &log, Cursor &cur, uint64_t end,
+    std::vector<int16_t> *out)
+{
+    uint64_t rate = (uint64_t)(sampleRate + 0.5f);
+    static constexpr int BUF_SIZE = 1024;
+    short buf[BUF_SIZE];
+
+    while(cur.cycle < end) {
+        // apply all events due at this cycle
+        while(cur.event < log.events.size() && log.events[cur.event].cycle <= cur.cycle) {
+            const SidLog::Event &ev = log.events[cur.event++];
+            if(ev.code == SidRecorder::CODE_INPUT) {
+                sid.input(ev.value);
+            } else {
+                sid.write(ev.code, (uint8_t)ev.value);
+            }
+        }
+        uint64_t next = end;
+        if(cur.event < log.events.size() && log.events[cur.event].cycle < end) {
+            next = log.events[cur.event].cycle;
+        }
+
+        if(out == nullptr) {
+            // state only: no sampling
+            while(cur.cycle < next) {
+                uint64_t chunk = std::min(next - cur.cycle, (uint64_t)0x10000000);
+                if(exactCheckpoints) {
+                    for(uint64_t i=0;i<chunk;i++) {
+                        sid.clock();
+                    }
+                } else {
+                    sid.clock((reSID::cycle_count)chunk);
+                }
+                cur.cycle += chunk;
+            }
+        } else if(method->direct) {
+            while(cur.cycle < next) {
+                uint64_t sampleEnd = (cur.sampleNo + 1) * log.clockHz / rate;
+                uint64_t stop = next < sampleEnd ? next : sampleEnd;
+                sid.clock((reSID::cycle_count)(stop - cur.cycle));
+                cur.cycle = stop;
+                if(cur.cycle == sampleEnd) {
+                    out->push_back(sid.output());
+                    cur.sampleNo++;
+                }
+            }
+        } else {
+            // clock in chunks that fit the cycle_count
+            while(cur.cycle < next) {
+                uint64_t chunk = std::min(next - cur.cycle, (uint64_t)0x10000000);
+                reSID::cycle_count delta = (reSID::cycle_count)chunk;
+                while(delta) {
+                    int n = sid.clock(delta, buf, BUF_SIZE);
+                    out->insert(out->end(), buf, buf + n);
+                }
+                cur.cycle += chunk;
+            }
+        }
+    }
+}
+
+bool SidLogRenderer::render(const SidLog &log, std::vector<int16_t> &out)
+{
+    std::unique_ptr<reSID::SID> sid(new reSID::SID());
+    if(!setupChip(*sid, log)) {
+        return false;
+    }
+    Cursor cur;
+    while(cur.cycle < log.endCycle) {
+        uint64_t end = log.endCycle;
+        if(splitCycles > 0 && cur.cycle + splitCycles < end) {
+            end = cur.cycle + splitCycles;
+        }
+        clockTo(*sid, log, cur, end, &out);
+        if(end == log.endCycle) {
+            break;
+        }
+        std::vector<unsigned char> data = sid->read_state().serialize();
+        reSID::SID::State state;
+        std::unique_ptr<reSID::SID> next(new reSID::SID());
+        setupChip(*next, log);
+        if(state.deserialize(data.data(), data.size())) {
+            next->write_state(state);
+        }
+        sid.swap(next);
+    }
+    return true;
+}
+
+bool SidLogRenderer::renderSegments(const SidLog &log, std::vector<int16_t> &out, WorkerPool &pool)
+{
+    std::unique_ptr<reSID::SID> sid(new reSID::SID());
+    if(!setupChip(*sid, log)) {
+        return false;
+    }
+
+    // segment and warm-up length on the sample grid
+    uint64_t grid = getGridCycles(log);
+    uint64_t segCycles = (uint64_t)(segmentSeconds * log.clockHz / grid + 0.5) * grid;
+    uint64_t warmCycles = (uint64_t)(warmupSeconds * log.clockHz / grid + 0.999) * grid;
+    segCycles = std::max(segCycles, grid);
+    warmCycles = std::max(warmCycles, grid);
+    size_t numSegments = (size_t)((log.endCycle + segCycles - 1) / segCycles);
+    // fast and direct sampling use delta clocking, its state can't be
+    // reproduced cheaper than by rendering
+    bool cycleExact = method->method != reSID::SAMPLE_FAST && !method->direct;
+    if(numSegments <= 1 || pool.getNumThreads() == 1 || !cycleExact) {
+        return render(log, out);
+    }
+
+    // cheap pass: chip state at the warm-up start of each segment
+    std::vector<Checkpoint> checkpoints(numSegments);
+    std::vector<Segment> segments(numSegments);
+    Cursor cur;
+    for(size_t i=0;i<numSegments;i++) {
+        Segment &seg = segments[i];
+        seg.renderer = this;
+        seg.log = &log;
+        seg.startCycle = i * segCycles;
+        seg.endCycle = std::min(seg.startCycle + segCycles, log.endCycle);
+        seg.warmupCycle = seg.startCycle > warmCycles ? seg.startCycle - warmCycles : 0;
+        seg.checkpoint = nullptr;
+        if(seg.warmupCycle > 0) {
+            clockTo(*sid, log, cur, seg.warmupCycle, nullptr);
+            checkpoints[i].cursor = cur;
+            checkpoints[i].state = sid->read_state();
+            seg.checkpoint = &checkpoints[i];
+        }
+    }
+
+    pool.run(segmentJob, &segments, (int)numSegments);
+
+    for(Segment &seg : segments) {
+        out.insert(out.end(), seg.out.begin(), seg.out.end());
+    }
+    return true;
+}
+
+void SidLogRenderer::segmentJob(void *context, int job)
+{
+    std::vector<Segment> &segments = *(std::vector<Segment> *)context;
+    Segment &seg = segments[job];
+    seg.renderer->renderSegment(seg);
+}
+
+void SidLogRenderer::renderSegment(Segment &seg)
+{
+    const SidLog &log = *seg.log;
+    std::unique_ptr<reSID::SID> sid(new reSID::SID());
+    setupChip(*sid, log);
+
+    Cursor cur;
+    if(seg.checkpoint) {
+        cur = seg.checkpoint->cursor;
+        sid->write_state(seg.checkpoint->state);
+    }
+    // the warm-up output is dropped, the resampler ring is full again
+    std::vector<int16_t> warmup;
+    clockTo(*sid, log, cur, seg.startCycle, &warmup);
+    clockTo(*sid, log, cur, seg.endCycle, &seg.out);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sid_recorder.h"
+#include "sid_script.h"
+#include "worker_pool.h"
+
+// A register log recorded by SidRecorder (see sid_recorder.h for the format)
+// with all events decoded.
+struct SidLog {
+    struct Event {
+        uint64_t cycle;
+        // register offset, SidRecorder::CODE_INPUT or CODE_END
+        uint8_t  code;
+        int16_t  value;
+    };
+
+    std::string name;
+    reSID::chip_model model = reSID::MOS8580;
+    uint32_t clockHz = 0;
+    std::vector<Event> events;
+    // cycle of the end event: length of the log
+    uint64_t endCycle = 0;
+
+    bool load(const std::string &path, std::string &error);
+    bool parse(const uint8_t *data, size_t size, std::string &error);
+
+    double getSeconds() const { return clockHz ? (double)endCycle / clockHz : 0.0; }
+};
+
+// Renders a register log with reSID directly: the chip is clocked from event
+// to event with the log's clock and any sampling method and sample rate.
+// The direct method picks the output at the end of each sample like
+// Sidofon's Direct mode.
+//
+// Long logs can be split into segments rendered in parallel. A cheap pass
+// without any sampling records a chip state checkpoint (SID::State) before
+// each segment. A segment chip starts at its checkpoint a warm-up time
+// early, so the filter and the resampler ring settle before its output is
+// used. Segments start on cycles where the output sample grid repeats, so
+// the samples of the segments line up with the ones of a serial render.
+//
+// The pass uses delta clocking like SAMPLE_FAST by default. It is several
+// times faster than a render, but reSID's delta clocking is not cycle exact
+// for the noise register: noise and combined waveforms continue with a
+// different (equally random) sequence in each segment. Exact checkpoints
+// clock the whole chip in single cycles. The checkpoint then holds the exact
+// filter state, and a short warm-up (a few ms) refills the
+// resampler ring, so the segments are bit identical to a serial render.
+// That pass costs about two thirds of a render.
+// Only the cycle exact methods (interpolate, resample, fastmem) are split.
+struct SidLogRenderer {
+    const SidMethod *method = &sidMethods[0];
+    float sampleRate = 44100.0f;
+    // length of a parallel segment and its warm-up,
+    // exact checkpoints only need a few ms for the resampler
+    double segmentSeconds = 10.0;
+    double warmupSeconds = 0.5;
+    // single cycle checkpoint pass
+    bool exactCheckpoints = false;
+    // render() continues on a new chip restored from the serialized state
+    // of the previous one every splitCycles cycles (0: never), which must
+    // not change the output if the state is complete
+    uint64_t splitCycles = 0;
+
+    // render the whole log and append the samples,
+    // false if the sampling method does not support the sample rate
+    bool render(const SidLog &log, std::vector<int16_t> &out);
+    // the same split into segments rendered by the pool
+    bool renderSegments(const SidLog &log, std::vector<int16_t> &out, WorkerPool &pool);
+
+    // cycles after which the output sample grid of reSID repeats
+    uint64_t getGridCycles(const SidLog &log);
+
+protected:
+    // position of a chip in the log
+    struct Cursor {
+        uint64_t cycle = 0;
+        size_t event = 0;
+        // direct method: number of the next output sample
+        uint64_t sampleNo = 0;
+    };
+
+    struct Checkpoint {
+        Cursor cursor;
+        reSID::SID::State state;
+    };
+
+    struct Segment {
+        SidLogRenderer *renderer;
+        const SidLog *log;
+        uint64_t warmupCycle;
+        uint64_t startCycle;
+        uint64_t endCycle;
+        const Checkpoint *checkpoint;
+        std::vector<int16_t> out;
+    };
+
+    bool setupChip(reSID::SID &sid, const SidLog &log);
+    // clock to the end cycle, apply the events on the way and append the
+    // samples to out, without out only the chip state is updated
+    void clockTo(reSID::SID &sid, const SidLog &log, Cursor &cur, uint64_t end,
+        std::vector<int16_t> *out);
+    void renderSegment(Segment &seg);
+    static void segmentJob(void *context, int job);
+};
@@ -0,0 +1,567 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "sid_script.h"
+
+const SidMethod sidMethods[] = {
+    { "fast", reSID::SAMPLE_FAST, false },
+    { "interpolate", reSID::SAMPLE_INTERPOLATE, false },
+    { "resample", reSID::SAMPLE_RESAMPLE, false },
+    { "fastmem", reSID::SAMPLE_RESAMPLE_FASTMEM, false },
+    { "direct", reSID::SAMPLE_RESAMPLE, true },
+};
+const int NUM_SID_METHODS = sizeof(sidMethods) / sizeof(sidMethods[0]);
+
+const SidModel sidModels[] = {
+    { "6581", reSID::MOS6581 },
+    { "8580", reSID::MOS8580 },
+};
+const int NUM_SID_MODELS = sizeof(sidModels) / sizeof(sidModels[0]);
+
+static const char *voiceParamNames[SidScript::NUM_VOICE_PARAMS] = {
+    "freq", "pw", "wave", "gate", "sync", "ring", "test",
+    "attack", "decay", "sustain", "release"
+};
+
+static const int voiceParamMax[SidScript::NUM_VOICE_PARAMS] = {
+    VoiceRegs::FREQ_MAX, VoiceRegs::PULSE_WIDTH_MAX, VoiceRegs::WAVE_MASK, 1, 1, 1, 1,
+    VoiceRegs::ATTACK_MAX, VoiceRegs::DECAY_MAX, VoiceRegs::SUSTAIN_MAX, VoiceRegs::RELEASE_MAX
+};
+
+static const char *filterParamNames[SidScript::NUM_FILTER_PARAMS] = {
+    "cutoff", "res", "voice", "ext", "mode", "3off", "volume"
+};
+
+static const int filterParamMax[SidScript::NUM_FILTER_PARAMS] = {
+    FilterRegs::CUTOFF_MAX, FilterRegs::RESONANCE_MAX, 1, 1, FilterRegs::MODE_MASK, 1,
+    FilterRegs::VOLUME_MAX
+};
+
+static int findName(const char **names, int num, const std::string &name)
+{
+    for(int i=0;i<num;i++) {
+        if(name == names[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool parseNumber(const std::string &word, int &value)
+{
+    if(word.empty()) {
+        return false;
+    }
+    char *end;
+    long v = strtol(word.c_str(), &end, 0);
+    if(*end != 0) {
+        return false;
+    }
+    value = (int)v;
+    return true;
+}
+
+static bool parseValue(const std::string &word, SidScript::Command &cmd)
+{
+    cmd.relative = (word[0] == '+' || word[0] == '-');
+    return parseNumber(word, cmd.value);
+}
+
+bool SidScript::load(const std::string &path, std::string &error)
+{
+    std::ifstream file(path);
+    if(!file) {
+        error = path + ": can't open";
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+
+    name = path;
+    if(!parse(text.str(), error)) {
+        error = path + ":" + error;
+        return false;
+    }
+    return true;
+}
+
+bool SidScript::parse(const std::string &text, std::string &error)
+{
+    // start index and count of open repeat blocks
+    std::vector<std::pair<size_t, int>> repeats;
+    std::istringstream lines(text);
+    std::string line;
+    int lineNo = 0;
+
+    commands.clear();
+    while(std::getline(lines, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if(hash != std::string::npos) {
+            line.erase(hash);
+        }
+        std::istringstream in(line);
+        std::vector<std::string> words;
+        std::string word;
+        while(in >> word) {
+            words.push_back(word);
+        }
+        if(words.empty()) {
+            continue;
+        }
+
+        const std::string &op = words[0];
+        Command cmd = {};
+        cmd.line = lineNo;
+        bool ok = false;
+        if(op == "voice" && words.size() == 4) {
+            // voice <1-3> <param> <value>
+            cmd.target = VOICE;
+            cmd.param = findName(voiceParamNames, NUM_VOICE_PARAMS, words[2]);
+            ok = parseNumber(words[1], cmd.voice) && cmd.voice >= 1 && cmd.voice <= 3
+                && cmd.param >= 0 && parseValue(words[3], cmd);
+            cmd.voice--;
+        }
+        else if(op == "filter" && words.size() >= 3) {
+            // filter <param> <value> or filter voice <1-3> <on>
+            cmd.target = FILTER;
+            cmd.param = findName(filterParamNames, NUM_FILTER_PARAMS, words[1]);
+            if(cmd.param == FILTER_VOICE) {
+                ok = words.size() == 4 && parseNumber(words[2], cmd.voice)
+                    && cmd.voice >= 1 && cmd.voice <= 3 && parseValue(words[3], cmd);
+                cmd.voice--;
+            } else {
+                ok = words.size() == 3 && cmd.param >= 0 && parseValue(words[2], cmd);
+            }
+        }
+        else if(op == "wait" && words.size() == 2) {
+            cmd.target = WAIT;
+            ok = parseNumber(words[1], cmd.value) && cmd.value >= 0;
+        }
+        else if(op == "repeat" && words.size() == 2) {
+            int count;
+            if(!parseNumber(words[1], count) || count < 0) {
+                error = std::to_string(lineNo) + ": invalid repeat count";
+                return false;
+            }
+            repeats.push_back(std::make_pair(commands.size(), count));
+            continue;
+        }
+        else if(op == "end" && words.size() == 1) {
+            if(repeats.empty()) {
+                error = std::to_string(lineNo) + ": end without repeat";
+                return false;
+            }
+            // unroll the block
+            size_t first = repeats.back().first;
+            int count = repeats.back().second;
+            repeats.pop_back();
+            std::vector<Command> block(commands.begin() + first, commands.end());
+            commands.resize(first);
+            for(int i=0;i<count;i++) {
+                commands.insert(commands.end(), block.begin(), block.end());
+            }
+            continue;
+        }
+
+        if(!ok) {
+            error = std::to_string(lineNo) + ": invalid command: " + line;
+            return false;
+        }
+        commands.push_back(cmd);
+    }
+
+    if(!repeats.empty()) {
+        error = "repeat without end";
+        return false;
+    }
+    return true;
+}
+
+long SidScript::getNumFrames() const
+{
+    long frames = 0;
+    for(const Command &cmd : commands) {
+        if(cmd.target == WAIT) {
+            frames += cmd.value;
+        }
+    }
+    return frames;
+}
+
+static int resolve(const SidScript::Command &cmd, int current, int max)
+{
+    int value = cmd.relative ? current + cmd.value : cmd.value;
+    return std::max(0, std::min(value, max));
+}
+
+void SidScriptRenderer::apply(const SidScript::Command &cmd, SidChannel &ch)
+{
+    if(cmd.target == SidScript::VOICE) {
+        VoiceRegs &v = ch.voiceRegs[cmd.voice];
+        int max = voiceParamMax[cmd.param];
+        switch(cmd.param) {
+            case SidScript::VOICE_FREQ:
+                v.setFreq(resolve(cmd, v.getFreq(), max));
+                break;
+            case SidScript::VOICE_PW:
+                v.setPulseWidth(resolve(cmd, v.getPulseWidth(), max));
+                break;
+            case SidScript::VOICE_WAVE:
+                v.setWaveform(resolve(cmd, v.getWaveform(), max) & VoiceRegs::WAVE_MASK);
+                break;
+            case SidScript::VOICE_GATE:
+                v.setGate(resolve(cmd, v.getGate(), max));
+                break;
+            case SidScript::VOICE_SYNC:
+                v.setSync(resolve(cmd, v.getSync(), max));
+                break;
+            case SidScript::VOICE_RING:
+                v.setRingMod(resolve(cmd, v.getRingMod(), max));
+                break;
+            case SidScript::VOICE_TEST:
+                v.setTest(resolve(cmd, v.getTest(), max));
+                break;
+            case SidScript::VOICE_ATTACK:
+                v.setAttack(resolve(cmd, v.getAttack(), max));
+                break;
+            case SidScript::VOICE_DECAY:
+                v.setDecay(resolve(cmd, v.getDecay(), max));
+                break;
+            case SidScript::VOICE_SUSTAIN:
+                v.setSustain(resolve(cmd, v.getSustain(), max));
+                break;
+            case SidScript::VOICE_RELEASE:
+                v.setRelease(resolve(cmd, v.getRelease(), max));
+                break;
+        }
+    }
+    else if(cmd.target == SidScript::FILTER) {
+        FilterRegs &f = ch.filterRegs;
+        int max = filterParamMax[cmd.param];
+        switch(cmd.param) {
+            case SidScript::FILTER_CUTOFF:
+                f.setCutOff(resolve(cmd, f.getCutOff(), max));
+                break;
+            case SidScript::FILTER_RES:
+                f.setResonance(resolve(cmd, f.getResonance(), max));
+                break;
+            case SidScript::FILTER_VOICE:
+                f.setFilterVoice(cmd.voice, resolve(cmd, f.getFilterVoice(cmd.voice), max));
+                break;
+            case SidScript::FILTER_EXT:
+                f.setFilterExt(resolve(cmd, f.getFilterExt(), max));
+                break;
+            case SidScript::FILTER_MODE:
+                f.setMode(resolve(cmd, f.getMode(), max) & FilterRegs::MODE_MASK);
+                break;
+            case SidScript::FILTER_3OFF:
+                f.setVoice3Off(resolve(cmd, f.getVoice3Off(), max));
+                break;
+            case SidScript::FILTER_VOLUME:
+                f.setVolume(resolve(cmd, f.getVolume(), max));
+                break;
+        }
+    }
+}
+
+SidEngine::Config SidScriptRenderer::getConfig(const SidModel &model, const SidMethod &method,
+    float cpuClockHz, float sampleRate, int blockSize)
+{
+    SidEngine::Config cfg;
+    cfg.chipModel = model.model;
+    cfg.samplingMethod = method.method;
+    cfg.direct = method.direct;
+    cfg.cpuClockHz = cpuClockHz;
+    cfg.sampleRate = sampleRate;
+    cfg.blockSize = blockSize;
+    return cfg;
+}
+
+void SidScriptRenderer::render(const SidScript &script, SidEngine &engine, std::vector<int16_t> &out)
+{
+    SidChannel &ch = engine.channels[0];
+    SidRenderer &renderer = ch.renderer;
+    renderer.readVoice3 = false;
+    // the chip rendered, replaced after every frame with restoreState
+    reSID::SID *sid = &ch.sid;
+    std::unique_ptr<reSID::SID> restored;
+
+    float samplesPerFrame = engine.config.sampleRate / frameRate;
+    float frameCounter = 0.0f;
+    int latency = renderer.getLatency();
+    size_t first = out.size();
+
+    beginLog(engine);
+    // unconnected aux input like in the module
+    renderer.input(0);
+
+    for(const SidScript::Command &cmd : script.commands) {
+        if(cmd.target != SidScript::WAIT) {
+            apply(cmd, ch);
+            continue;
+        }
+        for(int frame=0;frame<cmd.value;frame++) {
+            // write changed registers at the start of the frame
+            for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
+                ch.voiceRegs[i].realize(renderer, i);
+            }
+            ch.filterRegs.realize(renderer);
+
+            frameCounter += samplesPerFrame;
+            while(frameCounter >= 1.0f) {
+                frameCounter -= 1.0f;
+                out.push_back(renderer.process(*sid));
+            }
+            if(restoreState) {
+                std::vector<unsigned char> data = sid->read_state().serialize();
+                reSID::SID::State state;
+                std::unique_ptr<reSID::SID> next(new reSID::SID());
+                SidEngine::setupChip(*next, engine.config.chipModel);
+                next->set_sampling_parameters(engine.cpuClockRealHz, engine.config.samplingMethod,
+                    engine.config.sampleRate);
+                if(state.deserialize(data.data(), data.size())) {
+                    next->write_state(state);
+                }
+                restored.swap(next);
+                sid = restored.get();
+            }
+        }
+    }
+
+    // flush the last block and drop the leading latency
+    for(int i=0;i<latency;i++) {
+        out.push_back(renderer.process(*sid));
+    }
+    out.erase(out.begin() + first, out.begin() + std::min(out.size(), first + latency));
+    endLog(engine);
+}
+
+void SidScriptRenderer::renderChannels(const std::vector<const SidScript*> &scripts,
+    SidEngine &engine, std::vector<std::vector<int16_t>> &out)
+{
+    int num = std::min((int)scripts.size(), engine.numChannels);
+    out.assign(num, std::vector<int16_t>());
+    float samplesPerFrame = engine.config.sampleRate / frameRate;
+    float frameCounter = 0.0f;
+    int latency = engine.channels[0].renderer.getLatency();
+
+    // position in the script and frames left to wait of each channel,
+    // samples recorded after the end to flush the latency
+    std::vector<size_t> pos(num, 0);
+    std::vector<int> wait(num, 0);
+    std::vector<int> flush(num, 0);
+    std::vector<bool> playing(num, false);
+
+    for(int c=0;c<engine.numChannels;c++) {
+        engine.channels[c].renderer.readVoice3 = false;
+        engine.channels[c].renderer.input(0);
+    }
+
+    bool running = true;
+    while(running) {
+        running = false;
+        for(int c=0;c<num;c++) {
+            SidChannel &ch = engine.channels[c];
+            const std::vector<SidScript::Command> &commands = scripts[c]->commands;
+            while(wait[c] == 0 && pos[c] < commands.size()) {
+                const SidScript::Command &cmd = commands[pos[c]++];
+                if(cmd.target == SidScript::WAIT) {
+                    wait[c] = cmd.value;
+                } else {
+                    apply(cmd, ch);
+                }
+            }
+            playing[c] = wait[c] > 0;
+            if(!playing[c]) {
+                continue;
+            }
+            wait[c]--;
+            running = true;
+            for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
+                ch.voiceRegs[i].realize(ch.renderer, i);
+            }
+            ch.filterRegs.realize(ch.renderer);
+        }
+        for(int c=0;c<num && !running;c++) {
+            running = flush[c] < latency;
+        }
+        if(!running) {
+            break;
+        }
+
+        frameCounter += samplesPerFrame;
+        while(frameCounter >= 1.0f) {
+            frameCounter -= 1.0f;
+            for(int c=0;c<engine.numChannels;c++) {
+                if(engine.channels[c].renderer.advance()) {
+                    engine.renderIds[engine.numRenderIds++] = c;
+                }
+            }
+            engine.render();
+            for(int c=0;c<num;c++) {
+                if(playing[c] || flush[c] < latency) {
+                    out[c].push_back(engine.channels[c].renderer.sample);
+                    flush[c] += playing[c] ? 0 : 1;
+                }
+            }
+        }
+    }
+
+    for(int c=0;c<num;c++) {
+        out[c].erase(out[c].begin(), out[c].begin() + std::min(out[c].size(), (size_t)latency));
+    }
+}
+
+void SidScriptRenderer::beginLog(SidEngine &engine)
+{
+    if(recorder) {
+        recorder->update(engine.config.chipModel, engine.cpuClockRealHz);
+        engine.channels[0].renderer.recorder = recorder;
+    }
+}
+
+void SidScriptRenderer::endLog(SidEngine &engine)
+{
+    if(recorder) {
+        recorder->stop();
+        recorder->update(engine.config.chipModel, engine.cpuClockRealHz);
+        engine.channels[0].renderer.recorder = nullptr;
+    }
+}
+
+bool SidScriptRenderer::renderDump(const std::string &path, SidEngine &engine, std::vector<int16_t> &out,
+    std::string &error)
+{
+    SidDumpPlayer player;
+    SidDumpStream *stream = new SidDumpStream();
+    if(!stream->open(path, false, error)) {
+        error = path + ": " + error;
+        delete stream;
+        return false;
+    }
+    player.request(stream);
+    while(player.fetch() == nullptr) {
+        std::this_thread::yield();
+    }
+
+    SidChannel &ch = engine.channels[0];
+    SidRenderer &renderer = ch.renderer;
+    renderer.readVoice3 = false;
+
+    float samplesPerFrame = engine.config.sampleRate / frameRate;
+    float frameCounter = 0.0f;
+    int latency = renderer.getLatency();
+    size_t first = out.size();
+    uint8_t regs[SidDumpStream::FRAME_SIZE];
+
+    beginLog(engine);
+    renderer.input(0);
+
+    for(;;) {
+        // offline: every frame is clocked, wait for the player instead of
+        // repeating a frame
+        SidDumpStream::Step step = stream->step(true, regs);
+        if(step == SidDumpStream::STEP_END) {
+            break;
+        }
+        if(step == SidDumpStream::STEP_NONE) {
+            std::this_thread::yield();
+            continue;
+        }
+        for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
+            ch.voiceRegs[i].setRegs(regs + i * VoiceRegs::NUM_REGS);
+            ch.voiceRegs[i].realize(renderer, i);
+        }
+        ch.filterRegs.setRegs(regs + VoiceRegs::NUM_VOICES * VoiceRegs::NUM_REGS);
+        ch.filterRegs.realize(renderer);
+
+        frameCounter += samplesPerFrame;
+        while(frameCounter >= 1.0f) {
+            frameCounter -= 1.0f;
+            out.push_back(renderer.process(ch.sid));
+        }
+    }
+    player.retire(stream);
+
+    for(int i=0;i<latency;i++) {
+        out.push_back(renderer.process(ch.sid));
+    }
+    out.erase(out.begin() + first, out.begin() + std::min(out.size(), first + latency));
+    endLog(engine);
+    return true;
+}
+
+bool SidScriptRenderer::saveDump(const SidScript &script, const std::string &path, std::string &error)
+{
+    FILE *fh = fopen(path.c_str(), "wb");
+    if(fh == nullptr) {
+        error = path + ": can't write";
+        return false;
+    }
+    // only the register shadows are used
+    std::unique_ptr<SidChannel> ch(new SidChannel());
+    for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
+        ch->voiceRegs[i].reset();
+    }
+    ch->filterRegs.reset();
+
+    for(const SidScript::Command &cmd : script.commands) {
+        if(cmd.target != SidScript::WAIT) {
+            apply(cmd, *ch);
+            continue;
+        }
+        for(int frame=0;frame<cmd.value;frame++) {
+            for(int i=0;i<VoiceRegs::NUM_VOICES;i++) {
+                fwrite(ch->voiceRegs[i].regs, 1, VoiceRegs::NUM_REGS, fh);
+            }
+            fwrite(ch->filterRegs.regs, 1, FilterRegs::NUM_REGS, fh);
+        }
+    }
+    if(fclose(fh) != 0) {
+        error = path + ": can't write";
+        return false;
+    }
+    return true;
+}
+
+static void putLE(FILE *fh, uint32_t value, int bytes)
+{
+    for(int i=0;i<bytes;i++) {
+        fputc((value >> (i * 8)) & 0xff, fh);
+    }
+}
+
+bool writeAudio(const char *path, const std::vector<int16_t> &audio, int sampleRate)
+{
+    FILE *fh = fopen(path, "wb");
+    if(fh == nullptr) {
+        return false;
+    }
+    size_t len = strlen(path);
+    if(len > 4 && strcmp(path + len - 4, ".wav") == 0) {
+        uint32_t dataSize = audio.size() * 2;
+        fwrite("RIFF", 1, 4, fh);
+        putLE(fh, 36 + dataSize, 4);
+        fwrite("WAVEfmt ", 1, 8, fh);
+        putLE(fh, 16, 4);               // fmt size
+        putLE(fh, 1, 2);                // PCM
+        putLE(fh, 1, 2);                // mono
+        putLE(fh, sampleRate, 4);
+        putLE(fh, sampleRate * 2, 4);   // byte rate
+        putLE(fh, 2, 2);                // block align
+        putLE(fh, 16, 2);               // bits per sample
+        fwrite("data", 1, 4, fh);
+        putLE(fh, dataSize, 4);
+    }
+    for(int16_t s : audio) {
+        putLE(fh, (uint16_t)s, 2);
+    }
+    return fclose(fh) == 0;
+}
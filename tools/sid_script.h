@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sid_dump.h"
+#include "sid_engine.h"
+#include "sid_recorder.h"
+
+// A register script drives the register shadows of Sidofon (VoiceRegs and
+// FilterRegs) just like the module's CVs do and waits a number of update
+// frames in between:
+//
+//   # 50 frames of a pulse with a filter sweep
+//   voice 1 wave 0x40
+//   voice 1 freq 7382
+//   voice 1 pw 2048
+//   voice 1 sustain 15
+//   voice 1 gate 1
+//   filter voice 1 1
+//   filter mode 0x10
+//   filter volume 15
+//   repeat 25
+//     filter cutoff +64
+//     wait 2
+//   end
+//
+// Values are decimal or 0x hex. A leading + or - changes the current value
+// and is clamped to the range of the parameter.
+struct SidScript {
+    enum Target {
+        VOICE,
+        FILTER,
+        WAIT
+    };
+
+    enum VoiceParam {
+        VOICE_FREQ,
+        VOICE_PW,
+        VOICE_WAVE,
+        VOICE_GATE,
+        VOICE_SYNC,
+        VOICE_RING,
+        VOICE_TEST,
+        VOICE_ATTACK,
+        VOICE_DECAY,
+        VOICE_SUSTAIN,
+        VOICE_RELEASE,
+        NUM_VOICE_PARAMS
+    };
+
+    enum FilterParam {
+        FILTER_CUTOFF,
+        FILTER_RES,
+        FILTER_VOICE,
+        FILTER_EXT,
+        FILTER_MODE,
+        FILTER_3OFF,
+        FILTER_VOLUME,
+        NUM_FILTER_PARAMS
+    };
+
+    struct Command {
+        Target target;
+        int param;
+        // voice 0..2 of voice commands and filter voice routing
+        int voice;
+        int value;
+        bool relative;
+        // script line for error messages
+        int line;
+    };
+
+    std::string name;
+    std::vector<Command> commands;
+
+    bool load(const std::string &path, std::string &error);
+    bool parse(const std::string &text, std::string &error);
+
+    // total number of frames waited
+    long getNumFrames() const;
+};
+
+// sampling methods and chip models selectable by name in the tools
+struct SidMethod {
+    const char *name;
+    reSID::sampling_method method;
+    // Sidofon's direct mode: clock delta cycles and pick the output
+    bool direct;
+};
+extern const SidMethod sidMethods[];
+extern const int NUM_SID_METHODS;
+
+struct SidModel {
+    const char *name;
+    reSID::chip_model model;
+};
+extern const SidModel sidModels[];
+extern const int NUM_SID_MODELS;
+
+// Renders a script offline with the plugin's engine and renderer.
+struct SidScriptRenderer {
+    // register update frames per second (50 Hz PAL vsync)
+    float frameRate = 50.0f;
+    // records the register log of the rendering if set and started
+    SidRecorder *recorder = nullptr;
+    // continue on a new chip restored from the serialized state of the
+    // previous one after every frame: a complete state does not change the
+    // output
+    bool restoreState = false;
+
+    // engine configuration of the tools for a model and method
+    static SidEngine::Config getConfig(const SidModel &model, const SidMethod &method,
+        float cpuClockHz, float sampleRate, int blockSize);
+
+    // render all frames of the script with channel 0 of the engine and
+    // append the audio samples. The renderer latency is compensated, so
+    // the output does not depend on the block size.
+    void render(const SidScript &script, SidEngine &engine, std::vector<int16_t> &out);
+
+    // render the scripts at once on the channels 0..n-1 of the engine,
+    // advancing and rendering all channels like the module does. Each
+    // script renders the same audio as with render(), channels whose script
+    // has ended keep running silently until the longest one ends.
+    void renderChannels(const std::vector<const SidScript*> &scripts, SidEngine &engine,
+        std::vector<std::vector<int16_t>> &out);
+
+    // render a register dump file streamed by SidDumpPlayer like the module
+    // plays it. Only changed registers are written, so a dump saved from a
+    // script renders the same audio if the writes are not spread.
+    bool renderDump(const std::string &path, SidEngine &engine, std::vector<int16_t> &out,
+        std::string &error);
+
+    // write the registers of each frame of the script as a register dump
+    static bool saveDump(const SidScript &script, const std::string &path, std::string &error);
+
+    static void apply(const SidScript::Command &cmd, SidChannel &ch);
+
+protected:
+    void beginLog(SidEngine &engine);
+    void endLog(SidEngine &engine);
+};
+
+// write mono 16 bit audio as WAV (.wav) or raw little endian samples
+bool writeAudio(const char *path, const std::vector<int16_t> &audio, int sampleRate);
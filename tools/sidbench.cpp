@@ -0,0 +1,614 @@
+// sidbench - per stage microbenchmarks of the reSID emulation
+//
+// Times the building blocks of the emulation (envelope, waveform, filter,
+// external filter) in isolation, the complete SID with each sampling
+// method and banks of SIDs clocked in lockstep. All inputs are derived from fixed register scenarios and a fixed
+// random seed, so the numbers are comparable between builds, e.g. with the
+// compact filter tables of sidbench_compact.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sid.h"
+#include "sidbank.h"
+
+using namespace reSID;
+
+// keeps results alive so the compiler can't drop the benchmarked code
+static volatile int sink;
+
+// ----------------------------------------------------------------------------
+// Register scenarios
+// ----------------------------------------------------------------------------
+
+struct VoiceSetup {
+    reg16 freq;
+    reg16 pw;
+    reg8 control;
+    reg8 attackDecay;
+    reg8 sustainRelease;
+};
+
+struct Scenario {
+    const char *name;
+    VoiceSetup voices[3];
+    // filter
+    reg16 cutoff;
+    reg8 resFilt;
+    reg8 modeVol;
+    // cycles between gate toggles (0: never)
+    int gatePeriod;
+};
+
+static const Scenario scenarios[] = {
+    { "saw", {
+        { 0x1cd6, 0x800, 0x21, 0x00, 0xf0 },
+        { 0x2b0c, 0x800, 0x21, 0x00, 0xf0 },
+        { 0x0e6b, 0x800, 0x21, 0x00, 0xf0 } },
+      0x400, 0x07, 0x1f, 0 },
+    { "pulse", {
+        { 0x1cd6, 0x200, 0x41, 0x09, 0xa6 },
+        { 0x2b0c, 0x800, 0x41, 0x09, 0xa6 },
+        { 0x0e6b, 0xe00, 0x41, 0x09, 0xa6 } },
+      0x400, 0x07, 0x1f, 20000 },
+    { "noise", {
+        { 0x4000, 0x800, 0x81, 0x08, 0x00 },
+        { 0x8000, 0x800, 0x81, 0x04, 0x00 },
+        { 0xe000, 0x800, 0x81, 0x0a, 0x00 } },
+      0x400, 0x07, 0x1f, 5000 },
+    { "sync", {
+        { 0x3000, 0x800, 0x23, 0x00, 0xf0 },
+        { 0x4500, 0x800, 0x17, 0x00, 0xf0 },
+        { 0x0700, 0x800, 0x21, 0x00, 0xf0 } },
+      0x400, 0x07, 0x1f, 0 },
+    { "combined", {
+        { 0x1cd6, 0x400, 0x71, 0x00, 0xf0 },
+        { 0x2b0c, 0x800, 0x61, 0x00, 0xf0 },
+        { 0x0e6b, 0xa00, 0x51, 0x00, 0xf0 } },
+      0x400, 0x07, 0x1f, 0 },
+    { "resonant", {
+        { 0x1cd6, 0x800, 0x21, 0x00, 0xf0 },
+        { 0x2b0c, 0x800, 0x41, 0x00, 0xf0 },
+        { 0x0e6b, 0x800, 0x81, 0x00, 0xf0 } },
+      0x200, 0xf7, 0x2f, 0 },
+};
+static constexpr int NUM_SCENARIOS = sizeof(scenarios) / sizeof(scenarios[0]);
+
+static const Scenario *findScenario(const char *name)
+{
+    for(int i=0;i<NUM_SCENARIOS;i++) {
+        if(strcmp(scenarios[i].name, name) == 0) {
+            return &scenarios[i];
+        }
+    }
+    return nullptr;
+}
+
+static void setupVoice(Voice &voice, const VoiceSetup &setup)
+{
+    voice.wave.writeFREQ_LO(setup.freq & 0xff);
+    voice.wave.writeFREQ_HI(setup.freq >> 8);
+    voice.wave.writePW_LO(setup.pw & 0xff);
+    voice.wave.writePW_HI(setup.pw >> 8);
+    voice.envelope.writeATTACK_DECAY(setup.attackDecay);
+    voice.envelope.writeSUSTAIN_RELEASE(setup.sustainRelease);
+    voice.writeCONTROL_REG(setup.control);
+}
+
+// writes are spaced by a cycle for the pipelined 8580 writes of SAMPLE_FAST
+static void writeSid(SID &sid, reg8 offset, reg8 value)
+{
+    sid.write(offset, value);
+    sid.clock(1);
+}
+
+static void setupSid(SID &sid, const Scenario &sc)
+{
+    for(int i=0;i<3;i++) {
+        const VoiceSetup &v = sc.voices[i];
+        writeSid(sid, i * 7 + 0, v.freq & 0xff);
+        writeSid(sid, i * 7 + 1, v.freq >> 8);
+        writeSid(sid, i * 7 + 2, v.pw & 0xff);
+        writeSid(sid, i * 7 + 3, v.pw >> 8);
+        writeSid(sid, i * 7 + 5, v.attackDecay);
+        writeSid(sid, i * 7 + 6, v.sustainRelease);
+        writeSid(sid, i * 7 + 4, v.control);
+    }
+    writeSid(sid, 0x15, sc.cutoff & 7);
+    writeSid(sid, 0x16, sc.cutoff >> 3);
+    writeSid(sid, 0x17, sc.resFilt);
+    writeSid(sid, 0x18, sc.modeVol);
+}
+
+// voice outputs in the range [-2048*255, 2047*255] from a fixed seed
+struct VoiceSignal {
+    static constexpr int SIZE = 4096;
+    int samples[SIZE];
+
+    VoiceSignal(unsigned seed)
+    {
+        for(int i=0;i<SIZE;i++) {
+            seed = seed * 1103515245 + 12345;
+            samples[i] = (int)((seed >> 8) % (4095 * 255)) - 2048 * 255;
+        }
+    }
+};
+
+// ----------------------------------------------------------------------------
+// Stages
+// ----------------------------------------------------------------------------
+
+struct Stage {
+    virtual ~Stage() {}
+    // run the stage for the given number of SID cycles
+    virtual void run(long cycles) = 0;
+};
+
+// EnvelopeGenerator::clock() of three voices with gate retriggers
+struct EnvelopeStage : Stage {
+    EnvelopeGenerator env[3];
+    const Scenario &sc;
+    cycle_count delta;
+    long gateCounter = 0;
+    reg8 gate = 1;
+
+    EnvelopeStage(const Scenario &scenario, cycle_count deltaT)
+    : sc(scenario), delta(deltaT)
+    {
+        for(int i=0;i<3;i++) {
+            env[i].writeATTACK_DECAY(sc.voices[i].attackDecay);
+            env[i].writeSUSTAIN_RELEASE(sc.voices[i].sustainRelease);
+            env[i].writeCONTROL_REG(gate);
+        }
+    }
+
+    void toggleGate(long cycles)
+    {
+        if(sc.gatePeriod == 0) {
+            return;
+        }
+        gateCounter += cycles;
+        if(gateCounter >= sc.gatePeriod) {
+            gateCounter -= sc.gatePeriod;
+            gate ^= 1;
+            for(int i=0;i<3;i++) {
+                env[i].writeCONTROL_REG(gate);
+            }
+        }
+    }
+
+    void run(long cycles) override
+    {
+        int out = 0;
+        for(long c=0;c<cycles;c+=delta) {
+            for(int i=0;i<3;i++) {
+                if(delta == 1) {
+                    env[i].clock();
+                } else {
+                    env[i].clock(delta);
+                }
+                out += env[i].output();
+            }
+            toggleGate(delta);
+        }
+        sink = out;
+    }
+};
+
+// WaveformGenerator clocking, synchronization and waveform output of three
+// voices. The delta version does not step to sync points like SID::clock().
+struct WaveStage : Stage {
+    Voice voice[3];
+    cycle_count delta;
+
+    WaveStage(const Scenario &sc, chip_model model, cycle_count deltaT)
+    : delta(deltaT)
+    {
+        for(int i=0;i<3;i++) {
+            voice[i].set_chip_model(model);
+            voice[i].set_sync_source(&voice[(i + 2) % 3]);
+        }
+        for(int i=0;i<3;i++) {
+            setupVoice(voice[i], sc.voices[i]);
+        }
+    }
+
+    void run(long cycles) override
+    {
+        int out = 0;
+        for(long c=0;c<cycles;c+=delta) {
+            for(int i=0;i<3;i++) {
+                if(delta == 1) {
+                    voice[i].wave.clock();
+                } else {
+                    voice[i].wave.clock(delta);
+                }
+            }
+            for(int i=0;i<3;i++) {
+                voice[i].wave.synchronize();
+            }
+            for(int i=0;i<3;i++) {
+                if(delta == 1) {
+                    voice[i].wave.set_waveform_output();
+                } else {
+                    voice[i].wave.set_waveform_output(delta);
+                }
+                out += voice[i].wave.output();
+            }
+        }
+        sink = out;
+    }
+};
+
+// Filter::clock() fed with pseudo random voice outputs
+struct FilterStage : Stage {
+    Filter filter;
+    VoiceSignal signal;
+    cycle_count delta;
+    int pos = 0;
+
+    FilterStage(const Scenario &sc, chip_model model, cycle_count deltaT)
+    : signal(0x5eed), delta(deltaT)
+    {
+        filter.set_chip_model(model);
+        filter.enable_filter(true);
+        filter.adjust_filter_bias(model == MOS6581 ? 0.5 : 0.0);
+        filter.writeFC_LO(sc.cutoff & 7);
+        filter.writeFC_HI(sc.cutoff >> 3);
+        filter.writeRES_FILT(sc.resFilt);
+        filter.writeMODE_VOL(sc.modeVol);
+    }
+
+    void run(long cycles) override
+    {
+        int out = 0;
+        for(long c=0;c<cycles;c+=delta) {
+            int v1 = signal.samples[pos];
+            int v2 = signal.samples[(pos + 1) & (VoiceSignal::SIZE - 1)];
+            int v3 = signal.samples[(pos + 2) & (VoiceSignal::SIZE - 1)];
+            pos = (pos + 3) & (VoiceSignal::SIZE - 1);
+            if(delta == 1) {
+                filter.clock(v1, v2, v3);
+            } else {
+                filter.clock(delta, v1, v2, v3);
+            }
+            out += filter.output();
+        }
+        sink = out;
+    }
+};
+
+// Filter::clock() of filters with different resonance, volume and voice
+// routing like the channels of a polyphonic module, each clocked for a batch
+// of cycles in turn. Each filter reads its own gain and summer tables, so
+// this shows the cache footprint of the lookup tables.
+struct FilterPolyStage : Stage {
+    static constexpr int NUM_FILTERS = 16;
+    static constexpr int BATCH = 32;
+    Filter filters[NUM_FILTERS];
+    VoiceSignal signal;
+    int pos = 0;
+    int next = 0;
+
+    FilterPolyStage(const Scenario &sc, chip_model model)
+    : signal(0x5eed)
+    {
+        for(int k=0;k<NUM_FILTERS;k++) {
+            Filter &filter = filters[k];
+            filter.set_chip_model(model);
+            filter.enable_filter(true);
+            filter.adjust_filter_bias(model == MOS6581 ? 0.5 : 0.0);
+            filter.writeFC_LO(sc.cutoff & 7);
+            filter.writeFC_HI((sc.cutoff >> 3) + k * 8);
+            filter.writeRES_FILT((k << 4) | (1 + k % 7));
+            filter.writeMODE_VOL((sc.modeVol & 0xf0) | (15 - k));
+        }
+    }
+
+    void run(long cycles) override
+    {
+        int out = 0;
+        for(long c=0;c<cycles;c+=BATCH) {
+            Filter &filter = filters[next];
+            next = (next + 1) % NUM_FILTERS;
+            for(int b=0;b<BATCH;b++) {
+                int v1 = signal.samples[pos];
+                int v2 = signal.samples[(pos + 1) & (VoiceSignal::SIZE - 1)];
+                int v3 = signal.samples[(pos + 2) & (VoiceSignal::SIZE - 1)];
+                pos = (pos + 3) & (VoiceSignal::SIZE - 1);
+                filter.clock(v1, v2, v3);
+                out += filter.output();
+            }
+        }
+        sink = out;
+    }
+};
+
+// ExternalFilter::clock() fed with pseudo random filter outputs
+struct ExtFilterStage : Stage {
+    ExternalFilter extfilt;
+    VoiceSignal signal;
+    cycle_count delta;
+    int pos = 0;
+
+    ExtFilterStage(cycle_count deltaT)
+    : signal(0xf117), delta(deltaT)
+    {
+        extfilt.enable_filter(true);
+    }
+
+    void run(long cycles) override
+    {
+        int out = 0;
+        for(long c=0;c<cycles;c+=delta) {
+            short vi = (short)(signal.samples[pos] >> 4);
+            pos = (pos + 1) & (VoiceSignal::SIZE - 1);
+            if(delta == 1) {
+                extfilt.clock(vi);
+            } else {
+                extfilt.clock(delta, vi);
+            }
+            out += extfilt.output();
+        }
+        sink = out;
+    }
+};
+
+// complete SID with audio sampling
+struct SidStage : Stage {
+    static constexpr int BUF_SIZE = 256;
+    SID sid;
+    short buf[BUF_SIZE];
+
+    SidStage(const Scenario &sc, chip_model model, sampling_method method)
+    {
+        sid.set_chip_model(model);
+        sid.set_voice_mask(0xf);
+        sid.enable_filter(true);
+        sid.adjust_filter_bias(model == MOS6581 ? 0.5 : 0.0);
+        sid.enable_external_filter(true);
+        // 22 cycles per sample like the module at 44.1 kHz PAL
+        sid.set_sampling_parameters(22 * 44100.0, method, 44100.0);
+        setupSid(sid, sc);
+    }
+
+    void run(long cycles) override
+    {
+        int out = 0;
+        while(cycles > 0) {
+            cycle_count delta = cycles > 0x10000 ? 0x10000 : (cycle_count)cycles;
+            cycles -= delta;
+            while(delta > 0) {
+                int n = sid.clock(delta, buf, BUF_SIZE);
+                if(n > 0) {
+                    out += buf[n - 1];
+                }
+            }
+        }
+        sink = out;
+    }
+};
+
+// SIDBank of chips with the same scenario, timed per chip cycle like SidStage
+struct BankStage : Stage {
+    static constexpr int BUF_SIZE = 256;
+    std::unique_ptr<SID[]> sids;
+    SIDBank bank;
+    int numChips;
+    short buf[SIDBank::MAX_CHIPS][BUF_SIZE];
+
+    BankStage(const Scenario &sc, chip_model model, sampling_method method, int num)
+    : sids(new SID[num]), numChips(num)
+    {
+        SID *chips[SIDBank::MAX_CHIPS];
+        for(int k=0;k<numChips;k++) {
+            SID &sid = sids[k];
+            sid.set_chip_model(model);
+            sid.set_voice_mask(0xf);
+            sid.enable_filter(true);
+            sid.adjust_filter_bias(model == MOS6581 ? 0.5 : 0.0);
+            sid.enable_external_filter(true);
+            sid.set_sampling_parameters(22 * 44100.0, method, 44100.0);
+            setupSid(sid, sc);
+            chips[k] = &sid;
+        }
+        bank.set_chips(chips, numChips);
+    }
+
+    void run(long cycles) override
+    {
+        short *bufs[SIDBank::MAX_CHIPS];
+        for(int k=0;k<numChips;k++) {
+            bufs[k] = buf[k];
+        }
+        int out = 0;
+        cycles /= numChips;
+        while(cycles > 0) {
+            cycle_count delta = cycles > 0x10000 ? 0x10000 : (cycle_count)cycles;
+            cycles -= delta;
+            while(delta > 0) {
+                int n = bank.clock(delta, bufs, BUF_SIZE);
+                if(n > 0) {
+                    out += buf[numChips - 1][n - 1];
+                }
+            }
+        }
+        sink = out;
+    }
+};
+
+// ----------------------------------------------------------------------------
+// Benchmark registry and runner
+// ----------------------------------------------------------------------------
+
+struct Benchmark {
+    std::string name;
+    std::function<Stage*()> create;
+};
+
+static const char *modelName(chip_model model)
+{
+    return model == MOS6581 ? "6581" : "8580";
+}
+
+static std::vector<Benchmark> createBenchmarks()
+{
+    std::vector<Benchmark> benches;
+    const chip_model models[] = { MOS6581, MOS8580 };
+    const cycle_count deltas[] = { 1, 22 };
+
+    for(const char *name : { "pulse", "noise" }) {
+        const Scenario *sc = findScenario(name);
+        for(cycle_count d : deltas) {
+            benches.push_back({ std::string("envelope/") + name + "/" + std::to_string(d),
+                [=]() { return new EnvelopeStage(*sc, d); } });
+        }
+    }
+    for(chip_model m : models) {
+        for(const char *name : { "saw", "noise", "sync", "combined" }) {
+            const Scenario *sc = findScenario(name);
+            for(cycle_count d : deltas) {
+                benches.push_back({ std::string("wave/") + modelName(m) + "/" + name
+                    + "/" + std::to_string(d),
+                    [=]() { return new WaveStage(*sc, m, d); } });
+            }
+        }
+    }
+    for(chip_model m : models) {
+        for(const char *name : { "saw", "resonant" }) {
+            const Scenario *sc = findScenario(name);
+            for(cycle_count d : deltas) {
+                benches.push_back({ std::string("filter/") + modelName(m) + "/"
+                    + (name == std::string("saw") ? "lowpass" : name) + "/" + std::to_string(d),
+                    [=]() { return new FilterStage(*sc, m, d); } });
+            }
+        }
+        const Scenario *sc = findScenario("resonant");
+        benches.push_back({ std::string("filter/") + modelName(m) + "/poly16/1",
+            [=]() { return new FilterPolyStage(*sc, m); } });
+    }
+    for(cycle_count d : deltas) {
+        benches.push_back({ std::string("extfilt/") + std::to_string(d),
+            [=]() { return new ExtFilterStage(d); } });
+    }
+
+    struct { const char *name; sampling_method method; } methods[] = {
+        { "fast", SAMPLE_FAST },
+        { "interpolate", SAMPLE_INTERPOLATE },
+        { "resample", SAMPLE_RESAMPLE },
+        { "fastmem", SAMPLE_RESAMPLE_FASTMEM },
+    };
+    for(chip_model m : models) {
+        for(const char *name : { "pulse", "sync", "resonant" }) {
+            const Scenario *sc = findScenario(name);
+            for(auto &method : methods) {
+                sampling_method sm = method.method;
+                benches.push_back({ std::string("sid/") + modelName(m) + "/" + name
+                    + "/" + method.name,
+                    [=]() { return new SidStage(*sc, m, sm); } });
+            }
+        }
+    }
+    for(chip_model m : models) {
+        for(const char *name : { "pulse", "resonant" }) {
+            const Scenario *sc = findScenario(name);
+            for(int i=1;i<4;i++) {
+                sampling_method sm = methods[i].method;
+                for(int numChips : { 4, 8 }) {
+                    benches.push_back({ std::string("bank/") + modelName(m) + "/" + name
+                        + "/" + methods[i].name + "/" + std::to_string(numChips),
+                        [=]() { return new BankStage(*sc, m, sm, numChips); } });
+                }
+            }
+        }
+    }
+    return benches;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: sidbench [options] [filter]...\n"
+        "  -t <secs>    minimum time per measurement (default: 0.1)\n"
+        "  -r <reps>    measurements per benchmark, the fastest is reported (default: 5)\n"
+        "  -l           list benchmarks\n"
+        "Only benchmarks containing one of the filter strings are run.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    double minTime = 0.1;
+    int reps = 5;
+    bool list = false;
+    std::vector<std::string> filters;
+
+    for(int i=1;i<argc;i++) {
+        if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            minTime = atof(argv[++i]);
+        } else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-l") == 0) {
+            list = true;
+        } else if(argv[i][0] == '-') {
+            usage();
+            return 1;
+        } else {
+            filters.push_back(argv[i]);
+        }
+    }
+    if(minTime <= 0 || reps < 1) {
+        usage();
+        return 1;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+
+    for(const Benchmark &bench : createBenchmarks()) {
+        bool match = filters.empty();
+        for(const std::string &f : filters) {
+            match |= bench.name.find(f) != std::string::npos;
+        }
+        if(!match) {
+            continue;
+        }
+        if(list) {
+            printf("%s\n", bench.name.c_str());
+            continue;
+        }
+
+        // table setup is not measured
+        std::unique_ptr<Stage> stage(bench.create());
+
+        // calibrate the number of cycles to the minimum time
+        long cycles = 22 * 1024;
+        for(;;) {
+            Clock::time_point t0 = Clock::now();
+            stage->run(cycles);
+            double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+            if(secs >= minTime) {
+                break;
+            }
+            cycles *= secs > minTime / 16 ? 2 : 8;
+        }
+
+        double best = 0.0;
+        for(int r=0;r<reps;r++) {
+            Clock::time_point t0 = Clock::now();
+            stage->run(cycles);
+            double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+            if(r == 0 || secs < best) {
+                best = secs;
+            }
+        }
+        printf("%-32s %8.2f ns/cycle %10.1f Mcycles/s\n", bench.name.c_str(),
+            best * 1e9 / cycles, cycles / best / 1e6);
+        fflush(stdout);
+    }
+    return 0;
+}
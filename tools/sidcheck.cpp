@@ -0,0 +1,879 @@
+// sidcheck - golden output regression check of the SID emulation
+//
+// Renders a corpus of register scripts with both chip models and all
+// sampling methods and compares the audio with stored reference checksums.
+// Optimizations of reSID must keep the output bit exact, so any difference
+// is reported with the first divergent sample and SID cycle.
+//
+// The reference file stores a CRC32 of the whole output and of every block
+// of BLOCK_SAMPLES samples, which narrows a divergence down to one block.
+// For the exact sample the raw reference outputs of a known good build can
+// be kept in a directory (-d).
+//
+// Before the scripts a few checks of the module code run: the spacing of
+// the register writes, the end of a register dump, the banks of channels
+// that pause and the cents error of the pitch table (PitchTable) with
+// common sample rates.
+//
+// With -s the chip state is saved through SID::State after every frame and
+// restored into a new chip, which must not change the output either. The
+// register log of each script is also split at arbitrary cycles into new
+// chips (checkSplitLog()).
+//
+// With -c the scripts of one model and method are rendered together on the
+// channels of one engine like polyphonic voices of the module, which clocks
+// the chips in lockstep (SIDBank). Each channel must still match its own
+// reference.
+//
+// With -t the filter lookup tables are cached in a directory
+// (Filter::set_table_cache()), so a cache written by one run and loaded by
+// the next must not change the output either.
+//
+// With -a a build that is not meant to be bit exact, e.g. with compact filter
+// tables (RESID_COMPACT_FILTER), is compared with the raw outputs of a known
+// good build and the largest sample error and the signal to noise ratio are
+// reported instead.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "pitch_table.h"
+#include "sid_log.h"
+#include "sid_script.h"
+
+static constexpr int BLOCK_SAMPLES = 1024;
+static constexpr float SAMPLE_RATE = 44100.0f;
+static constexpr float CPU_CLOCK_HZ = 985248.0f;
+
+struct Crc32 {
+    uint32_t table[256];
+
+    Crc32()
+    {
+        for(uint32_t i=0;i<256;i++) {
+            uint32_t c = i;
+            for(int k=0;k<8;k++) {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+
+    uint32_t calc(const int16_t *samples, size_t num) const
+    {
+        uint32_t crc = 0xffffffff;
+        for(size_t i=0;i<num;i++) {
+            uint16_t s = (uint16_t)samples[i];
+            crc = table[(crc ^ s) & 0xff] ^ (crc >> 8);
+            crc = table[(crc ^ (s >> 8)) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+};
+
+// checksums of one script rendered with one model and method
+struct Reference {
+    std::string script;
+    std::string model;
+    std::string method;
+    size_t numSamples = 0;
+    uint32_t crc = 0;
+    std::vector<uint32_t> blockCrcs;
+
+    void calc(const Crc32 &crc32, const std::vector<int16_t> &audio)
+    {
+        numSamples = audio.size();
+        crc = crc32.calc(audio.data(), audio.size());
+        blockCrcs.clear();
+        for(size_t pos=0;pos<audio.size();pos+=BLOCK_SAMPLES) {
+            size_t num = std::min(audio.size() - pos, (size_t)BLOCK_SAMPLES);
+            blockCrcs.push_back(crc32.calc(audio.data() + pos, num));
+        }
+    }
+
+    std::string getRawName() const
+    {
+        std::string base = script;
+        size_t slash = base.find_last_of('/');
+        if(slash != std::string::npos) {
+            base.erase(0, slash + 1);
+        }
+        size_t dot = base.find_last_of('.');
+        if(dot != std::string::npos) {
+            base.erase(dot);
+        }
+        return base + "_" + model + "_" + method + ".raw";
+    }
+};
+
+static bool loadReferences(const char *path, std::vector<Reference> &refs)
+{
+    std::ifstream file(path);
+    if(!file) {
+        return false;
+    }
+    std::string line;
+    while(std::getline(file, line)) {
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream in(line);
+        Reference ref;
+        in >> ref.script >> ref.model >> ref.method >> ref.numSamples >> std::hex >> ref.crc;
+        uint32_t crc;
+        while(in >> crc) {
+            ref.blockCrcs.push_back(crc);
+        }
+        if(!in.eof() || ref.method.empty()) {
+            fprintf(stderr, "%s: invalid line: %s\n", path, line.c_str());
+            return false;
+        }
+        refs.push_back(ref);
+    }
+    return true;
+}
+
+static bool saveReferences(const char *path, const std::vector<Reference> &refs)
+{
+    FILE *fh = fopen(path, "w");
+    if(fh == nullptr) {
+        return false;
+    }
+    fprintf(fh, "# sidcheck reference outputs at %.0f Hz, block size %d samples:\n"
+        "# script model method samples crc32 block_crc32...\n", SAMPLE_RATE, BLOCK_SAMPLES);
+    for(const Reference &ref : refs) {
+        fprintf(fh, "%s %s %s %zu %08x", ref.script.c_str(), ref.model.c_str(),
+            ref.method.c_str(), ref.numSamples, ref.crc);
+        for(uint32_t crc : ref.blockCrcs) {
+            fprintf(fh, " %08x", crc);
+        }
+        fprintf(fh, "\n");
+    }
+    return fclose(fh) == 0;
+}
+
+static bool loadRaw(const std::string &path, std::vector<int16_t> &audio)
+{
+    FILE *fh = fopen(path.c_str(), "rb");
+    if(fh == nullptr) {
+        return false;
+    }
+    int16_t buf[4096];
+    size_t n;
+    while((n = fread(buf, sizeof(int16_t), 4096, fh)) > 0) {
+        audio.insert(audio.end(), buf, buf + n);
+    }
+    fclose(fh);
+    return true;
+}
+
+static bool saveRaw(const std::string &path, const std::vector<int16_t> &audio)
+{
+    FILE *fh = fopen(path.c_str(), "wb");
+    if(fh == nullptr) {
+        return false;
+    }
+    fwrite(audio.data(), sizeof(int16_t), audio.size(), fh);
+    return fclose(fh) == 0;
+}
+
+static const SidModel *findModel(const std::string &name)
+{
+    for(int i=0;i<NUM_SID_MODELS;i++) {
+        if(name == sidModels[i].name) {
+            return &sidModels[i];
+        }
+    }
+    return nullptr;
+}
+
+static const SidMethod *findMethod(const std::string &name)
+{
+    for(int i=0;i<NUM_SID_METHODS;i++) {
+        if(name == sidMethods[i].name) {
+            return &sidMethods[i];
+        }
+    }
+    return nullptr;
+}
+
+static bool render(const Reference &ref, int blockSize, bool restoreState,
+    std::vector<int16_t> &audio, reSID::cycle_count &cyclesPerSample)
+{
+    const SidModel *model = findModel(ref.model);
+    const SidMethod *method = findMethod(ref.method);
+    if(model == nullptr || method == nullptr) {
+        fprintf(stderr, "%s: unknown model/method %s/%s\n", ref.script.c_str(),
+            ref.model.c_str(), ref.method.c_str());
+        return false;
+    }
+    SidScript script;
+    std::string error;
+    if(!script.load(ref.script, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return false;
+    }
+
+    SidEngine engine;
+    engine.configure(SidScriptRenderer::getConfig(*model, *method,
+        CPU_CLOCK_HZ, SAMPLE_RATE, blockSize));
+    cyclesPerSample = engine.cpuClockSteps;
+
+    SidScriptRenderer renderer;
+    renderer.restoreState = restoreState;
+    renderer.render(script, engine, audio);
+    return true;
+}
+
+// render the scripts of refs (same model and method) on one channel each
+static bool renderChannels(const std::vector<Reference*> &refs, int blockSize,
+    std::vector<std::vector<int16_t>> &audio, reSID::cycle_count &cyclesPerSample)
+{
+    const SidModel *model = findModel(refs[0]->model);
+    const SidMethod *method = findMethod(refs[0]->method);
+    if(model == nullptr || method == nullptr) {
+        fprintf(stderr, "unknown model/method %s/%s\n", refs[0]->model.c_str(),
+            refs[0]->method.c_str());
+        return false;
+    }
+    std::vector<SidScript> scripts(refs.size());
+    std::vector<const SidScript*> scriptPtrs;
+    for(size_t i=0;i<refs.size();i++) {
+        std::string error;
+        if(!scripts[i].load(refs[i]->script, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        scriptPtrs.push_back(&scripts[i]);
+    }
+
+    SidEngine::Config cfg = SidScriptRenderer::getConfig(*model, *method,
+        CPU_CLOCK_HZ, SAMPLE_RATE, blockSize);
+    cfg.numChannels = (int)refs.size();
+    SidEngine engine;
+    engine.configure(cfg);
+    cyclesPerSample = engine.cpuClockSteps;
+
+    SidScriptRenderer renderer;
+    renderer.renderChannels(scriptPtrs, engine, audio);
+    return true;
+}
+
+// compare with the reference and report the first divergence
+static bool compare(const Crc32 &crc32, const Reference &ref, const std::vector<int16_t> &audio,
+    reSID::cycle_count cyclesPerSample, const char *rawDir, std::string &detail)
+{
+    char buf[128];
+    Reference cur = ref;
+    cur.calc(crc32, audio);
+    if(cur.numSamples == ref.numSamples && cur.crc == ref.crc && cur.blockCrcs == ref.blockCrcs) {
+        return true;
+    }
+
+    // sample exact with the raw reference output
+    std::vector<int16_t> expected;
+    if(rawDir && loadRaw(std::string(rawDir) + "/" + ref.getRawName(), expected)) {
+        size_t num = std::min(audio.size(), expected.size());
+        for(size_t i=0;i<num;i++) {
+            if(audio[i] != expected[i]) {
+                snprintf(buf, sizeof(buf), "first divergent sample %zu (cycle %zu): %d, expected %d",
+                    i, i * cyclesPerSample, audio[i], expected[i]);
+                detail = buf;
+                return false;
+            }
+        }
+    }
+
+    size_t numBlocks = std::min(cur.blockCrcs.size(), ref.blockCrcs.size());
+    for(size_t b=0;b<numBlocks;b++) {
+        if(cur.blockCrcs[b] != ref.blockCrcs[b]) {
+            size_t first = b * BLOCK_SAMPLES;
+            size_t last = std::min(first + BLOCK_SAMPLES, cur.numSamples) - 1;
+            snprintf(buf, sizeof(buf), "first divergent block: samples %zu-%zu (cycles %zu-%zu)",
+                first, last, first * cyclesPerSample, (last + 1) * cyclesPerSample - 1);
+            detail = buf;
+            return false;
+        }
+    }
+    snprintf(buf, sizeof(buf), "length %zu samples, expected %zu", cur.numSamples, ref.numSamples);
+    detail = buf;
+    return false;
+}
+
+// The writes of one sample land writeCycles apart and spill into the next
+// sample, independent of the block size: the chip state at the end of each
+// rendered block shows how many writes have landed.
+static bool checkWriteSpacing(int blockSize, std::string &detail)
+{
+    const reSID::cycle_count cyclesPerSample = 22;
+    const int writeCycles = SidRenderer::WRITE_CYCLES;
+    const int numWrites = 10;
+    std::unique_ptr<reSID::SID> sid(new reSID::SID());
+    std::unique_ptr<SidRenderer> renderer(new SidRenderer());
+    renderer->configure(blockSize, cyclesPerSample, true, writeCycles);
+    renderer->readVoice3 = false;
+
+    // values 1..n to the frequency and pulse width registers of the voices
+    for(int i=0;i<numWrites;i++) {
+        renderer->write(i, i + 1);
+    }
+    for(int n=0;n<2*blockSize;n++) {
+        renderer->process(*sid);
+        if(renderer->pos != 0) {
+            continue;
+        }
+        reSID::cycle_count end = (n + 1) * cyclesPerSample;
+        int landed = std::min(numWrites, (int)((end + writeCycles - 1) / writeCycles));
+        reSID::SID::State state = sid->read_state();
+        int num = 0;
+        while(num < numWrites && state.sid_register[num] == num + 1) {
+            num++;
+        }
+        if(num != landed) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "%d writes landed after sample %d (cycle %d), expected %d",
+                num, n, end, landed);
+            detail = buf;
+            return false;
+        }
+    }
+    return true;
+}
+
+// a new temporary file for writing
+static FILE *createTempFile(std::string &path)
+{
+    const char *tmpDir = getenv("TMPDIR");
+    path = std::string(tmpDir ? tmpDir : "/tmp") + "/sidcheck_XXXXXX";
+    int fd = mkstemp(&path[0]);
+    return fd >= 0 ? fdopen(fd, "wb") : nullptr;
+}
+
+// The registers of the last frame of a dump reach the chip before the dump
+// ends, played by SidDumpStream::step() like in the module.
+static bool checkDumpEnd(int blockSize, std::string &detail)
+{
+    const int numFrames = 3;
+    std::string path;
+    FILE *fh = createTempFile(path);
+    if(fh == nullptr) {
+        detail = "can't write " + path;
+        return false;
+    }
+    // silent frames, then one with a different value in every register
+    // (within the bits the chip keeps)
+    uint8_t regs[SidDumpStream::FRAME_SIZE];
+    for(int f=0;f<numFrames;f++) {
+        for(int i=0;i<SidDumpStream::FRAME_SIZE;i++) {
+            regs[i] = f == numFrames - 1 ? 1 + i % 7 : 0;
+        }
+        fwrite(regs, 1, sizeof(regs), fh);
+    }
+    fclose(fh);
+
+    SidEngine engine;
+    engine.configure(SidScriptRenderer::getConfig(sidModels[1], sidMethods[NUM_SID_METHODS - 1],
+        CPU_CLOCK_HZ, SAMPLE_RATE, blockSize));
+    SidScriptRenderer renderer;
+    std::vector<int16_t> audio;
+    bool ok = renderer.renderDump(path, engine, audio, detail);
+    remove(path.c_str());
+    if(!ok) {
+        return false;
+    }
+
+    reSID::SID::State state = engine.channels[0].sid.read_state();
+    for(int i=0;i<SidDumpStream::FRAME_SIZE;i++) {
+        if(state.sid_register[i] != regs[i]) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "register $%02x is %d, expected %d from the last frame",
+                i, (int)state.sid_register[i], regs[i]);
+            detail = buf;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Banks are formed over the channels that are played: channels that pause
+// and join the running block again must still be rendered in banks, and
+// bit exact like a chip clocked on its own by an engine without banks.
+static bool checkPausedBanks(int blockSize, std::string &detail)
+{
+    const int numChannels = 8;
+    // played channels from the sample on
+    const int phases[][2] = { { 0, numChannels }, { 1000, 3 }, { 2345, numChannels }, { 4000, 0 } };
+    SidEngine::Config cfg = SidScriptRenderer::getConfig(sidModels[0], sidMethods[1],
+        CPU_CLOCK_HZ, SAMPLE_RATE, blockSize);
+    cfg.numChannels = numChannels;
+    SidEngine engine, single;
+    engine.configure(cfg);
+    single.configure(cfg);
+    SidEngine *engines[] = { &engine, &single };
+
+    // a sawtooth of another pitch on every channel
+    for(SidEngine *e : engines) {
+        for(int c=0;c<numChannels;c++) {
+            SidRenderer &renderer = e->channels[c].renderer;
+            renderer.readVoice3 = false;
+            renderer.write(0x01, 8 + 3 * c);
+            renderer.write(0x06, 0xf0);
+            renderer.write(0x18, 0x0f);
+            renderer.write(0x04, 0x21);
+        }
+    }
+
+    int active = 0;
+    for(int p=0;phases[p][1] > 0;p++) {
+        int channels = phases[p][1];
+        for(SidEngine *e : engines) {
+            for(int c=std::max(active, 1);c<channels;c++) {
+                e->resume(c);
+            }
+        }
+        active = channels;
+        for(int n=phases[p][0];n<phases[p + 1][0];n++) {
+            for(SidEngine *e : engines) {
+                for(int c=0;c<active;c++) {
+                    if(e->channels[c].renderer.advance()) {
+                        e->renderIds[e->numRenderIds++] = c;
+                    }
+                }
+            }
+            engine.render();
+            for(int i=0;i<single.numRenderIds;i++) {
+                SidChannel &ch = single.channels[single.renderIds[i]];
+                ch.renderer.render(ch.sid);
+            }
+            single.numRenderIds = 0;
+            for(int c=0;c<active;c++) {
+                int16_t got = engine.channels[c].renderer.sample;
+                int16_t expected = single.channels[c].renderer.sample;
+                if(got != expected) {
+                    char buf[128];
+                    snprintf(buf, sizeof(buf), "channel %d of %d, sample %d: %d, expected %d",
+                        c, active, n, got, expected);
+                    detail = buf;
+                    return false;
+                }
+            }
+        }
+        // the played channels were rendered in banks
+        bool inBanks = engine.bankChannels == active && engine.numBanks > 0;
+        for(int b=0;b<engine.numBanks && inBanks;b++) {
+            inBanks = engine.banks[b].in_lockstep();
+        }
+        if(!inBanks) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "%d played channels not rendered in banks", active);
+            detail = buf;
+            return false;
+        }
+    }
+    return true;
+}
+
+// The pitch range of the module: the knob of +-54 semitones plus +-10V CV.
+// From C1 up the SID registers are large enough that the FREQ register of
+// the pitch table must stay within MAX_PITCH_CENTS of the exact frequency.
+// Anywhere it may be at most 0.1 steps farther off than rounding.
+static constexpr float MAX_PITCH = 54.0f + 120.0f;
+static constexpr float MIN_CENTS_PITCH = -36.0f;
+static constexpr double MAX_PITCH_CENTS = 2.0;
+static constexpr double MAX_PITCH_STEPS = 0.6;
+
+static bool checkPitchTable(float sampleRate, double &maxCents, std::string &detail)
+{
+    // the CPU clocks of the module, rounded to whole cycles per sample as
+    // by SidEngine::configure()
+    const float cpuClocksHz[] = { 985248.0f, 1022727.0f };
+    PitchTable table;
+    maxCents = 0.0;
+    for(float cpuClockHz : cpuClocksHz) {
+        float cpuClockRealHz = roundf(cpuClockHz / sampleRate) * sampleRate;
+        table.setClock(cpuClockRealHz);
+        for(int i=-100*(int)MAX_PITCH;i<=100*(int)MAX_PITCH;i++) {
+            float pitch = i / 100.0f;
+            double exact = PitchTable::FREQ_C4 * std::exp2(pitch / 12.0) * 16777216.0 / cpuClockRealHz;
+            double reg = table.getFreqReg(pitch);
+            double steps = std::fabs(reg - std::min(exact, 65535.0));
+            double cents = 0.0;
+            if(pitch >= MIN_CENTS_PITCH && exact <= 65535.0) {
+                cents = std::fabs(1200.0 * std::log2(reg / exact));
+                maxCents = std::max(maxCents, cents);
+            }
+            if(steps > MAX_PITCH_STEPS || cents > MAX_PITCH_CENTS) {
+                char buf[160];
+                snprintf(buf, sizeof(buf), "clock %.0f Hz, pitch %.2f: register %.0f, exact %.3f (%.2f cents)",
+                    cpuClockRealHz, pitch, reg, exact, cents);
+                detail = buf;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// -s: the register log of a script rendered by SidLogRenderer must not change
+// when the chip is restored into a new one every SPLIT_CYCLES cycles. The
+// splits fall on every phase of the sample grid and between the writes.
+// Delta clocking (fast, direct) depends on where the clocking stops, so
+// there the splits fall on the end of every SPLIT_SAMPLES samples.
+static constexpr uint64_t SPLIT_CYCLES = 4999;
+static constexpr uint64_t SPLIT_SAMPLES = 227;
+
+static bool checkSplitLog(const Reference &ref, std::string &detail)
+{
+    const SidModel *model = findModel(ref.model);
+    const SidMethod *method = findMethod(ref.method);
+    SidScript script;
+    if(model == nullptr || method == nullptr || !script.load(ref.script, detail)) {
+        return false;
+    }
+    std::string path;
+    FILE *fh = createTempFile(path);
+    if(fh == nullptr) {
+        detail = "can't write " + path;
+        return false;
+    }
+    fclose(fh);
+    // cycles per sample of the log
+    uint64_t engineSteps = 1;
+    {
+        // the recorder ends the log when it is deleted
+        SidRecorder recorder;
+        if(!recorder.start(path, detail)) {
+            remove(path.c_str());
+            return false;
+        }
+        SidEngine engine;
+        engine.configure(SidScriptRenderer::getConfig(*model, *method,
+            CPU_CLOCK_HZ, SAMPLE_RATE, 1));
+        engineSteps = engine.cpuClockSteps;
+        SidScriptRenderer renderer;
+        renderer.recorder = &recorder;
+        std::vector<int16_t> audio;
+        renderer.render(script, engine, audio);
+    }
+    SidLog log;
+    bool ok = log.load(path, detail);
+    remove(path.c_str());
+    if(!ok) {
+        return false;
+    }
+
+    SidLogRenderer renderer;
+    renderer.method = method;
+    renderer.sampleRate = SAMPLE_RATE;
+    std::vector<int16_t> serial;
+    std::vector<int16_t> split;
+    renderer.render(log, serial);
+    bool delta = method->direct || method->method == reSID::SAMPLE_FAST;
+    renderer.splitCycles = delta ? SPLIT_SAMPLES * engineSteps : SPLIT_CYCLES;
+    renderer.render(log, split);
+    for(size_t i=0;i<serial.size() && i<split.size();i++) {
+        if(split[i] != serial[i]) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "log split every %d cycles: first divergent sample %zu: %d, expected %d",
+                (int)renderer.splitCycles, i, split[i], serial[i]);
+            detail = buf;
+            return false;
+        }
+    }
+    if(split.size() != serial.size()) {
+        detail = "log split: length differs";
+        return false;
+    }
+    return true;
+}
+
+// deviation of the output from the raw reference output
+struct Accuracy {
+    int maxError = 0;
+    double signal = 0.0;
+    double noise = 0.0;
+
+    void calc(const std::vector<int16_t> &audio, const std::vector<int16_t> &expected)
+    {
+        for(size_t i=0;i<audio.size();i++) {
+            int diff = audio[i] - expected[i];
+            maxError = std::max(maxError, std::abs(diff));
+            signal += (double)expected[i] * expected[i];
+            noise += (double)diff * diff;
+        }
+    }
+
+    // signal to noise ratio in dB, infinite if exact
+    double getSnr() const
+    {
+        return 10.0 * std::log10(signal / noise);
+    }
+};
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: sidcheck [options] <reference file> [script]...\n"
+        "  -u           update the reference file with the output of this build\n"
+        "               (for the given scripts or all scripts already listed)\n"
+        "  -d <dir>     raw reference outputs: written with -u and used to find\n"
+        "               the exact divergent sample otherwise\n"
+        "  -b <size>    render block size in samples (default: %d)\n"
+        "  -s           restore the chip state into a new chip after every frame\n"
+        "               and at arbitrary cycles of the register log\n"
+        "  -c <num>     render up to num scripts at once on the channels of one\n"
+        "               engine (max %d)\n"
+        "  -t <dir>     cache the filter lookup tables in dir\n"
+        "  -a           report the accuracy against the raw outputs of -d instead\n"
+        "               of checking for bit exact output\n",
+        SidRenderer::MAX_BLOCK_SIZE, SidEngine::MAX_CHANNELS);
+}
+
+int main(int argc, char *argv[])
+{
+    bool update = false;
+    bool restoreState = false;
+    bool accuracy = false;
+    const char *rawDir = nullptr;
+    int blockSize = SidRenderer::MAX_BLOCK_SIZE;
+    int numChannels = 1;
+    const char *refFile = nullptr;
+    std::vector<std::string> scripts;
+
+    for(int i=1;i<argc;i++) {
+        if(strcmp(argv[i], "-u") == 0) {
+            update = true;
+        } else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            rawDir = argv[++i];
+        } else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            blockSize = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            numChannels = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            reSID::Filter::set_table_cache(argv[++i]);
+        } else if(strcmp(argv[i], "-s") == 0) {
+            restoreState = true;
+        } else if(strcmp(argv[i], "-a") == 0) {
+            accuracy = true;
+        } else if(argv[i][0] == '-') {
+            usage();
+            return 1;
+        } else if(refFile == nullptr) {
+            refFile = argv[i];
+        } else {
+            scripts.push_back(argv[i]);
+        }
+    }
+    if(refFile == nullptr || (!update && !scripts.empty())
+        || numChannels < 1 || numChannels > SidEngine::MAX_CHANNELS
+        || (numChannels > 1 && (update || restoreState))
+        || (accuracy && (update || numChannels > 1 || rawDir == nullptr))) {
+        usage();
+        return 1;
+    }
+
+    std::vector<Reference> refs;
+    if(!loadReferences(refFile, refs) && !update) {
+        fprintf(stderr, "%s: can't read\n", refFile);
+        return 1;
+    }
+    if(update && !scripts.empty()) {
+        refs.clear();
+        for(const std::string &script : scripts) {
+            for(int m=0;m<NUM_SID_MODELS;m++) {
+                for(int s=0;s<NUM_SID_METHODS;s++) {
+                    Reference ref;
+                    ref.script = script;
+                    ref.model = sidModels[m].name;
+                    ref.method = sidMethods[s].name;
+                    refs.push_back(ref);
+                }
+            }
+        }
+    }
+
+    Crc32 crc32;
+    int failed = 0;
+    if(numChannels > 1) {
+        // group the references of each model and method in listed order
+        std::vector<bool> done(refs.size(), false);
+        for(size_t i=0;i<refs.size();i++) {
+            if(done[i]) {
+                continue;
+            }
+            std::vector<Reference*> group;
+            for(size_t j=i;j<refs.size() && (int)group.size()<numChannels;j++) {
+                if(!done[j] && refs[j].model == refs[i].model && refs[j].method == refs[i].method) {
+                    group.push_back(&refs[j]);
+                    done[j] = true;
+                }
+            }
+
+            std::vector<std::vector<int16_t>> audio;
+            reSID::cycle_count cyclesPerSample = 0;
+            bool ok = renderChannels(group, blockSize, audio, cyclesPerSample);
+            for(size_t c=0;c<group.size();c++) {
+                const Reference &ref = *group[c];
+                printf("%s %s %s (channel %zu/%zu): ", ref.script.c_str(), ref.model.c_str(),
+                    ref.method.c_str(), c + 1, group.size());
+                std::string detail;
+                if(!ok) {
+                    printf("FAILED\n");
+                    failed++;
+                } else if(compare(crc32, ref, audio[c], cyclesPerSample, rawDir, detail)) {
+                    printf("ok\n");
+                } else {
+                    printf("FAILED, %s\n", detail.c_str());
+                    failed++;
+                }
+            }
+        }
+        printf("%zu checks, %d failed\n", refs.size(), failed);
+        return failed ? 1 : 0;
+    }
+
+    if(accuracy) {
+#if RESID_COMPACT_FILTER
+        // the MOS8580 filter only uses the DC level of the mixer, which is exact
+        printf("compact filter tables, 1/%d entries: max table error %d\n",
+            1 << RESID_COMPACT_FILTER, reSID::Filter::compact_error(reSID::MOS6581));
+#endif
+        Accuracy total;
+        double minSnr = INFINITY;
+        for(Reference &ref : refs) {
+            printf("%s %s %s: ", ref.script.c_str(), ref.model.c_str(), ref.method.c_str());
+            fflush(stdout);
+
+            std::vector<int16_t> audio;
+            std::vector<int16_t> expected;
+            reSID::cycle_count cyclesPerSample = 0;
+            if(!render(ref, blockSize, restoreState, audio, cyclesPerSample)) {
+                failed++;
+                continue;
+            }
+            if(!loadRaw(std::string(rawDir) + "/" + ref.getRawName(), expected)
+                || expected.size() != audio.size()) {
+                printf("FAILED, no raw output of %zu samples\n", audio.size());
+                failed++;
+                continue;
+            }
+
+            Accuracy acc;
+            acc.calc(audio, expected);
+            total.maxError = std::max(total.maxError, acc.maxError);
+            total.signal += acc.signal;
+            total.noise += acc.noise;
+            if(acc.noise == 0.0) {
+                printf("exact\n");
+            } else {
+                minSnr = std::min(minSnr, acc.getSnr());
+                printf("max error %d, snr %.1f dB\n", acc.maxError, acc.getSnr());
+            }
+        }
+        printf("%zu checks, %d failed, max error %d, snr %.1f dB (min %.1f dB)\n", refs.size(),
+            failed, total.maxError, total.getSnr(), minSnr);
+        return failed ? 1 : 0;
+    }
+
+    // renderer checks with the block sizes of the module and pitch table
+    // checks with common sample rates
+    int numChecks = 0;
+    if(!update) {
+        const int blockSizes[] = { 1, 32, SidRenderer::MAX_BLOCK_SIZE };
+        for(int size : blockSizes) {
+            printf("write spacing (block size %d): ", size);
+            std::string detail;
+            if(checkWriteSpacing(size, detail)) {
+                printf("ok\n");
+            } else {
+                printf("FAILED, %s\n", detail.c_str());
+                failed++;
+            }
+            numChecks++;
+        }
+        for(int size : blockSizes) {
+            printf("paused banks (block size %d): ", size);
+            std::string detail;
+            if(checkPausedBanks(size, detail)) {
+                printf("ok\n");
+            } else {
+                printf("FAILED, %s\n", detail.c_str());
+                failed++;
+            }
+            numChecks++;
+        }
+        const float sampleRates[] = { 44100.0f, 48000.0f, 88200.0f, 96000.0f, 192000.0f };
+        for(float rate : sampleRates) {
+            printf("pitch table (sample rate %.0f): ", rate);
+            std::string detail;
+            double maxCents = 0.0;
+            if(checkPitchTable(rate, maxCents, detail)) {
+                printf("ok, max error %.3f cents\n", maxCents);
+            } else {
+                printf("FAILED, %s\n", detail.c_str());
+                failed++;
+            }
+            numChecks++;
+        }
+        for(int size : blockSizes) {
+            printf("dump end (block size %d): ", size);
+            std::string detail;
+            if(checkDumpEnd(size, detail)) {
+                printf("ok\n");
+            } else {
+                printf("FAILED, %s\n", detail.c_str());
+                failed++;
+            }
+            numChecks++;
+        }
+    }
+
+    for(Reference &ref : refs) {
+        printf("%s %s %s: ", ref.script.c_str(), ref.model.c_str(), ref.method.c_str());
+        fflush(stdout);
+
+        std::vector<int16_t> audio;
+        reSID::cycle_count cyclesPerSample = 0;
+        if(!render(ref, blockSize, restoreState, audio, cyclesPerSample)) {
+            failed++;
+            continue;
+        }
+
+        if(update) {
+            ref.calc(crc32, audio);
+            if(rawDir && !saveRaw(std::string(rawDir) + "/" + ref.getRawName(), audio)) {
+                fprintf(stderr, "%s: can't write raw output\n", rawDir);
+                return 1;
+            }
+            printf("%zu samples %08x\n", ref.numSamples, ref.crc);
+            continue;
+        }
+
+        std::string detail;
+        if(compare(crc32, ref, audio, cyclesPerSample, rawDir, detail)
+            && (!restoreState || checkSplitLog(ref, detail))) {
+            printf("ok\n");
+        } else {
+            printf("FAILED, %s\n", detail.c_str());
+            failed++;
+        }
+    }
+
+    if(update) {
+        if(!saveReferences(refFile, refs)) {
+            fprintf(stderr, "%s: can't write\n", refFile);
+            return 1;
+        }
+    } else {
+        printf("%zu checks, %d failed\n", refs.size() + numChecks, failed);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,240 @@
+// sidlog - render register logs recorded by Sidofon offline in high quality
+//
+// Live playing needs a cheap sample mode, a final mix wants the resampling
+// mode at a high sample rate. sidlog renders the logs of the Register Log
+// menu (or sidrender -l) with any sampling method and rate and writes WAV
+// files. The files are rendered in parallel, one job per log. With -S long
+// logs are split into segments instead and all threads render the segments
+// of one log.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sid_log.h"
+#include "worker_pool.h"
+
+struct Options {
+    std::vector<std::string> logs;
+    const SidMethod *method = nullptr;
+    const SidModel *model = nullptr;
+    const char *outputDir = nullptr;
+    float sampleRate = 96000.0f;
+    int threads = 0;
+    // segment-parallel rendering if not 0
+    double segmentSeconds = 0.0;
+    double warmupSeconds = 0.5;
+    bool exactCheckpoints = false;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: sidlog [options] <log.sidw>...\n"
+        "  -s <method>  fast, interpolate, resample, fastmem or direct (default: resample)\n"
+        "  -r <rate>    sample rate in Hz (default: 96000)\n"
+        "  -m <model>   render with 6581 or 8580 instead of the recorded model\n"
+        "  -j <threads> render threads (default: all cores)\n"
+        "  -S <secs>    split each log into segments rendered in parallel\n"
+        "  -W <secs>    warm-up before a segment (default: 0.5)\n"
+        "  -x           cycle exact segment checkpoints (slower)\n"
+        "  -o <dir>     directory of the WAV files (default: next to the log)\n");
+}
+
+static bool parseArgs(int argc, char *argv[], Options &opts)
+{
+    for(int i=1;i<argc;i++) {
+        const char *arg = argv[i];
+        if(arg[0] != '-') {
+            opts.logs.push_back(arg);
+            continue;
+        }
+        if(strcmp(arg, "-x") == 0) {
+            opts.exactCheckpoints = true;
+            continue;
+        }
+        if(i + 1 == argc || arg[2] != 0) {
+            return false;
+        }
+        const char *val = argv[++i];
+        switch(arg[1]) {
+            case 's':
+                for(int m=0;m<NUM_SID_METHODS;m++) {
+                    if(strcmp(val, sidMethods[m].name) == 0) {
+                        opts.method = &sidMethods[m];
+                    }
+                }
+                if(opts.method == nullptr) {
+                    return false;
+                }
+                break;
+            case 'm':
+                for(int m=0;m<NUM_SID_MODELS;m++) {
+                    if(strcmp(val, sidModels[m].name) == 0) {
+                        opts.model = &sidModels[m];
+                    }
+                }
+                if(opts.model == nullptr) {
+                    return false;
+                }
+                break;
+            case 'r':
+                opts.sampleRate = atof(val);
+                break;
+            case 'j':
+                opts.threads = atoi(val);
+                break;
+            case 'o':
+                opts.outputDir = val;
+                break;
+            case 'S':
+                opts.segmentSeconds = atof(val);
+                break;
+            case 'W':
+                opts.warmupSeconds = atof(val);
+                break;
+            default:
+                return false;
+        }
+    }
+    if(opts.method == nullptr) {
+        for(int m=0;m<NUM_SID_METHODS;m++) {
+            if(sidMethods[m].method == reSID::SAMPLE_RESAMPLE && !sidMethods[m].direct) {
+                opts.method = &sidMethods[m];
+            }
+        }
+    }
+    if(opts.threads <= 0) {
+        opts.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return !opts.logs.empty() && opts.sampleRate > 0
+        && opts.segmentSeconds >= 0 && opts.warmupSeconds >= 0;
+}
+
+static std::string getOutputPath(const std::string &log, const char *dir)
+{
+    std::string base = log;
+    size_t dot = base.rfind('.');
+    size_t slash = base.rfind('/');
+    if(dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        base.erase(dot);
+    }
+    if(dir) {
+        base = std::string(dir) + "/" + (slash == std::string::npos ? base : base.substr(slash + 1));
+    }
+    return base + ".wav";
+}
+
+struct Job {
+    std::string path;
+    std::string output;
+    std::string error;
+    double seconds = 0.0;
+    double renderTime = 0.0;
+    size_t numSamples = 0;
+};
+
+struct Context {
+    const Options *opts;
+    std::vector<Job> jobs;
+    // renders the segments of a log
+    WorkerPool *segmentPool = nullptr;
+};
+
+static void renderJob(void *context, int jobNo)
+{
+    typedef std::chrono::steady_clock Clock;
+    Context *ctx = (Context *)context;
+    const Options &opts = *ctx->opts;
+    Job &job = ctx->jobs[jobNo];
+
+    SidLog log;
+    if(!log.load(job.path, job.error)) {
+        return;
+    }
+    if(opts.model) {
+        log.model = opts.model->model;
+    }
+    job.seconds = log.getSeconds();
+
+    Clock::time_point t0 = Clock::now();
+    std::vector<int16_t> audio;
+    SidLogRenderer renderer;
+    renderer.method = opts.method;
+    renderer.sampleRate = opts.sampleRate;
+    bool ok;
+    if(ctx->segmentPool) {
+        renderer.segmentSeconds = opts.segmentSeconds;
+        renderer.warmupSeconds = opts.warmupSeconds;
+        renderer.exactCheckpoints = opts.exactCheckpoints;
+        ok = renderer.renderSegments(log, audio, *ctx->segmentPool);
+    } else {
+        ok = renderer.render(log, audio);
+    }
+    if(!ok) {
+        job.error = job.path + ": sample rate not supported by the method";
+        return;
+    }
+    job.renderTime = std::chrono::duration<double>(Clock::now() - t0).count();
+    job.numSamples = audio.size();
+
+    if(!writeAudio(job.output.c_str(), audio, (int)opts.sampleRate)) {
+        job.error = job.output + ": can't write";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    typedef std::chrono::steady_clock Clock;
+    Options opts;
+    if(!parseArgs(argc, argv, opts)) {
+        usage();
+        return 1;
+    }
+
+    Context ctx;
+    ctx.opts = &opts;
+    for(const std::string &path : opts.logs) {
+        Job job;
+        job.path = path;
+        job.output = getOutputPath(path, opts.outputDir);
+        ctx.jobs.push_back(job);
+    }
+
+    int threads = opts.threads;
+    Clock::time_point t0 = Clock::now();
+    if(opts.segmentSeconds > 0.0) {
+        // one log after the other, its segments in parallel
+        WorkerPool pool(threads);
+        ctx.segmentPool = &pool;
+        for(size_t i=0;i<ctx.jobs.size();i++) {
+            renderJob(&ctx, (int)i);
+        }
+    } else {
+        threads = std::min(threads, (int)ctx.jobs.size());
+        WorkerPool pool(threads);
+        pool.run(renderJob, &ctx, (int)ctx.jobs.size());
+    }
+    double wall = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    int failed = 0;
+    double total = 0.0;
+    for(const Job &job : ctx.jobs) {
+        if(!job.error.empty()) {
+            fprintf(stderr, "%s\n", job.error.c_str());
+            failed++;
+            continue;
+        }
+        double secs = job.renderTime > 0.0 ? job.renderTime : 1e-9;
+        printf("%s: %.1f s, %zu samples  x%7.1f realtime -> %s\n", job.path.c_str(),
+            job.seconds, job.numSamples, job.seconds / secs, job.output.c_str());
+        total += job.seconds;
+    }
+    printf("%s %.0f Hz, %d threads: %.1f s of audio in %.2f s  x%.1f realtime\n",
+        opts.method->name, opts.sampleRate, threads, total, wall, total / (wall > 0.0 ? wall : 1e-9));
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,252 @@
+// sidrender - render Sidofon register scripts offline without Rack
+//
+// Renders each script with every selected chip model and sampling method
+// as fast as possible and reports the achieved emulation speed. Optionally
+// the audio of a single model/method is written to a WAV or raw file.
+// Register dumps (.dmp) are streamed like the module plays them.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sid_script.h"
+
+struct Options {
+    std::vector<std::string> scripts;
+    std::vector<const SidMethod*> methods;
+    std::vector<const SidModel*> models;
+    const char *outputFile = nullptr;
+    const char *dumpFile = nullptr;
+    const char *logFile = nullptr;
+    float sampleRate = 44100.0f;
+    float cpuClockHz = 985248.0f;
+    float frameRate = 50.0f;
+    int blockSize = SidRenderer::MAX_BLOCK_SIZE;
+    int writeCycles = SidRenderer::WRITE_CYCLES;
+    int runs = 1;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: sidrender [options] <script|dump.dmp>...\n"
+        "  -m <model>   6581, 8580 or all (default: all)\n"
+        "  -s <method>  fast, interpolate, resample, fastmem, direct or all (default: all)\n"
+        "  -r <rate>    sample rate in Hz (default: 44100)\n"
+        "  -c <clock>   CPU clock in Hz (default: 985248, PAL)\n"
+        "  -f <rate>    register update frames per second (default: 50)\n"
+        "  -b <size>    render block size in samples (default: %d)\n"
+        "  -w <cycles>  cycles between the register writes of a frame (default: %d)\n"
+        "  -n <runs>    repeat each render and report the fastest run (default: 1)\n"
+        "  -o <file>    write audio of a single model/method (.wav or 16 bit raw)\n"
+        "  -d <file>    save a single script as register dump and exit\n"
+        "  -l <file>    record the register log of a single model/method\n",
+        SidRenderer::MAX_BLOCK_SIZE, SidRenderer::WRITE_CYCLES);
+}
+
+static bool parseArgs(int argc, char *argv[], Options &opts)
+{
+    for(int i=1;i<argc;i++) {
+        const char *arg = argv[i];
+        if(arg[0] != '-') {
+            opts.scripts.push_back(arg);
+            continue;
+        }
+        if(i + 1 == argc || arg[2] != 0) {
+            return false;
+        }
+        const char *val = argv[++i];
+        bool all = strcmp(val, "all") == 0;
+        switch(arg[1]) {
+            case 'm':
+                for(int m=0;m<NUM_SID_MODELS;m++) {
+                    if(all || strcmp(val, sidModels[m].name) == 0) {
+                        opts.models.push_back(&sidModels[m]);
+                    }
+                }
+                if(opts.models.empty()) {
+                    return false;
+                }
+                break;
+            case 's':
+                for(int m=0;m<NUM_SID_METHODS;m++) {
+                    if(all || strcmp(val, sidMethods[m].name) == 0) {
+                        opts.methods.push_back(&sidMethods[m]);
+                    }
+                }
+                if(opts.methods.empty()) {
+                    return false;
+                }
+                break;
+            case 'r':
+                opts.sampleRate = atof(val);
+                break;
+            case 'c':
+                opts.cpuClockHz = atof(val);
+                break;
+            case 'f':
+                opts.frameRate = atof(val);
+                break;
+            case 'b':
+                opts.blockSize = atoi(val);
+                break;
+            case 'w':
+                opts.writeCycles = atoi(val);
+                break;
+            case 'n':
+                opts.runs = atoi(val);
+                break;
+            case 'o':
+                opts.outputFile = val;
+                break;
+            case 'd':
+                opts.dumpFile = val;
+                break;
+            case 'l':
+                opts.logFile = val;
+                break;
+            default:
+                return false;
+        }
+    }
+    if(opts.models.empty()) {
+        for(int m=0;m<NUM_SID_MODELS;m++) {
+            opts.models.push_back(&sidModels[m]);
+        }
+    }
+    if(opts.methods.empty()) {
+        for(int m=0;m<NUM_SID_METHODS;m++) {
+            opts.methods.push_back(&sidMethods[m]);
+        }
+    }
+    if((opts.outputFile || opts.logFile) && (opts.scripts.size() != 1
+        || opts.models.size() != 1 || opts.methods.size() != 1)) {
+        fprintf(stderr, "-o and -l need a single script, model and method\n");
+        return false;
+    }
+    if(opts.dumpFile && opts.scripts.size() != 1) {
+        fprintf(stderr, "-d needs a single script\n");
+        return false;
+    }
+    return !opts.scripts.empty() && opts.sampleRate > 0 && opts.cpuClockHz > 0
+        && opts.frameRate > 0 && opts.runs > 0;
+}
+
+static bool isDump(const std::string &path)
+{
+    return path.size() > 4 && path.compare(path.size() - 4, 4, ".dmp") == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    Options opts;
+    if(!parseArgs(argc, argv, opts)) {
+        usage();
+        return 1;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    int failed = 0;
+
+    for(const std::string &path : opts.scripts) {
+        SidScript script;
+        std::string error;
+        bool dump = isDump(path);
+        if(dump) {
+            SidDumpStream stream;
+            if(!stream.open(path, false, error)) {
+                fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+                failed++;
+                continue;
+            }
+            printf("%s: %lu frames\n", path.c_str(), (unsigned long)stream.getNumFrames());
+        } else {
+            if(!script.load(path, error)) {
+                fprintf(stderr, "%s\n", error.c_str());
+                failed++;
+                continue;
+            }
+            printf("%s: %ld frames\n", path.c_str(), script.getNumFrames());
+        }
+
+        if(opts.dumpFile) {
+            if(dump || !SidScriptRenderer::saveDump(script, opts.dumpFile, error)) {
+                fprintf(stderr, "%s\n", dump ? "-d needs a script" : error.c_str());
+                return 1;
+            }
+            return 0;
+        }
+
+        for(const SidModel *model : opts.models) {
+            for(const SidMethod *method : opts.methods) {
+                SidEngine::Config cfg = SidScriptRenderer::getConfig(*model, *method,
+                    opts.cpuClockHz, opts.sampleRate, opts.blockSize);
+                cfg.writeCycles = opts.writeCycles;
+
+                double best = 0.0;
+                double setup = 0.0;
+                reSID::cycle_count cyclesPerSample = 0;
+                std::vector<int16_t> audio;
+                for(int run=0;run<opts.runs;run++) {
+                    Clock::time_point t0 = Clock::now();
+                    SidEngine engine;
+                    engine.configure(cfg);
+                    cyclesPerSample = engine.cpuClockSteps;
+                    Clock::time_point t1 = Clock::now();
+
+                    audio.clear();
+                    SidScriptRenderer renderer;
+                    renderer.frameRate = opts.frameRate;
+                    // the recorder closes the log when it is deleted
+                    std::unique_ptr<SidRecorder> recorder;
+                    if(opts.logFile && run == 0) {
+                        recorder.reset(new SidRecorder());
+                        if(!recorder->start(opts.logFile, error)) {
+                            fprintf(stderr, "%s: %s\n", opts.logFile, error.c_str());
+                            return 1;
+                        }
+                        renderer.recorder = recorder.get();
+                    }
+                    if(dump) {
+                        if(!renderer.renderDump(path, engine, audio, error)) {
+                            fprintf(stderr, "%s\n", error.c_str());
+                            return 1;
+                        }
+                    } else {
+                        renderer.render(script, engine, audio);
+                    }
+                    Clock::time_point t2 = Clock::now();
+                    if(recorder && recorder->getDropped() > 0) {
+                        fprintf(stderr, "%s: %u events lost\n", opts.logFile, recorder->getDropped());
+                    }
+
+                    double secs = std::chrono::duration<double>(t2 - t1).count();
+                    if(run == 0 || secs < best) {
+                        best = secs;
+                        setup = std::chrono::duration<double>(t1 - t0).count();
+                    }
+                }
+
+                double samples = audio.size();
+                double cycles = samples * cyclesPerSample;
+                double secs = best > 0.0 ? best : 1e-9;
+                printf("  %s %-12s %10.0f samples/s %12.0f cycles/s  x%7.1f realtime"
+                    "  (setup %.1f ms)\n",
+                    model->name, method->name, samples / secs, cycles / secs,
+                    samples / opts.sampleRate / secs, setup * 1000.0);
+
+                if(opts.outputFile) {
+                    if(!writeAudio(opts.outputFile, audio, (int)opts.sampleRate)) {
+                        fprintf(stderr, "%s: can't write\n", opts.outputFile);
+                        failed++;
+                    }
+                }
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}